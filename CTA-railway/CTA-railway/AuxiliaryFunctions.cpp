@@ -2,6 +2,10 @@
 //Header Files
 #include "util.hpp"
 #include "Simulation.hpp"
+#include "Scheduler.hpp"
+#include "EventLog.hpp"
+#include "RoutingIndex.hpp"
+#include <cstring>
 
 // if it is the OD just put into the system, lineID should be -1
 int Simulation::getNextStation(int from, int to, int lineID) {
@@ -10,21 +14,19 @@ int Simulation::getNextStation(int from, int to, int lineID) {
 		return from;
 	}
 
-	// choose the peak/off-peak hour matrix
-	int** _policy_num = policy_num;
-	int*** _policy = policy_offpeak;
-	if ((time >= 19080 && time <= 33900) || (time >= 51900 && time <= 66600))	// peak hour
-		_policy = policy;
+	// the policy set of the time slice, see updateSlice()
+	const RouteEntry& route = sliceRoutes->at(from, to);
+	const int* _policy = slicePeak ? route.policy : route.policy_offpeak;
 
-	int num = _policy_num[from][to];
+	int num = route.policy_num;
 	int nextStation;
 	bool transfer = true;
 	if (num == 1) {
-		nextStation = _policy[from][to][0];
+		nextStation = _policy[0];
 	}
 	else {
 		for (int i = 0; i < num; i++) {
-			nextStation = _policy[from][to][i];
+			nextStation = _policy[i];
 			// if there is an optimal solution on the same line, abandon the transfer
 			if (stations[nextStation].lineID == lineID) {
 				transfer = false;
@@ -33,7 +35,7 @@ int Simulation::getNextStation(int from, int to, int lineID) {
 		}
 		if (transfer) {
 			// randomly choose a station to transfer to
-			nextStation = _policy[from][to][rand() % num];
+			nextStation = _policy[rng() % num];
 		}
 	}
 	return nextStation;
@@ -43,16 +45,26 @@ int Simulation::getNextStation(int from, int to, int lineID) {
 // NOTE: check the real station before use this function!
 // the 'from' station must be the real station to get on the train
 void Simulation::addPassengers(int from, int to, int num) {
-	// check if the passenger can take the train, will cost some time.
-	double _temp;
-	int _real_station = getRealStation(from, to, _temp);
-	if (_real_station != from) {
-		// if not satisfy the requirement...
-		throw "Not real station!";
+	// check if the passenger can take the train, the precomputed closure also gives the direction
+	int direction;
+	const TransferClosure& closure = sliceRoutes->closure(from, to, slicePeak);
+	if (closure.realStation >= 0) {
+		if (closure.realStation != from)
+			throw "Not real station!";
+		direction = closure.direction;
 	}
+	else {
+		// a random choice on the way, will cost some time.
+		double _temp;
+		int _real_station = getRealStation(from, to, _temp);
+		if (_real_station != from) {
+			// if not satisfy the requirement...
+			throw "Not real station!";
+		}
 
-	int _next_station = getNextStation(from, to, -1);
-	int direction = directions[from][_next_station];
+		int _next_station = getNextStation(from, to, -1);
+		direction = routes->at(from, _next_station).direction;
+	}
 	Station* station = &stations[from];
 
 	// push the passengers into the queue, update avg_inStationTime
@@ -61,12 +73,8 @@ void Simulation::addPassengers(int from, int to, int num) {
 	station->avg_inStationTime[direction] = (queue_len * station->avg_inStationTime[direction] + double(num) * time) / new_len;
 	// debug
 	if (station->avg_inStationTime[direction] > time)
-		cout << "ERROR: time error!\n";
-	WaitingPassengers passengers;
-
-	passengers.destination = to;
-	passengers.numPassengers = num;
-	station->queue[direction].push(passengers);
+		eventLog().log(LOG_WAIT_TIME_ERROR, time, from, -1, num, station->avg_inStationTime[direction]);
+	queues.push(from * 2 + direction, to, num);
 	station->queueSize[direction] += num;
 	station->numPass[direction] += num;
 }
@@ -75,17 +83,132 @@ void Simulation::addPassengers(int from, int to, int num) {
 // Note that the result station can be the destination, meaning that the destination can be achieved only by transfering...
 // If the real station == from, it means that the passenger doesn't need to transfer.
 int Simulation::getRealStation(int from, int to, double& _transfer_time) {
+	// usually precomputed, see RouteTable::buildClosure()
+	const TransferClosure& closure = sliceRoutes->closure(from, to, slicePeak);
+	if (closure.realStation >= 0) {
+		_transfer_time = closure.transferTime;
+		return closure.realStation;
+	}
+
 	_transfer_time = 0.0;
+	STATS(stats.counters[STAT_REAL_STATION_WALKS]++);
 	int nextStation = getNextStation(from, to, -1);
-	while (transferTime[from][nextStation] != -1) {
+	while (routes->at(from, nextStation).transferTime != -1) {
 		// meaning the two stations are transfer stations to each other.
-		_transfer_time += transferTime[from][nextStation];
+		STATS(stats.counters[STAT_REAL_STATION_STEPS]++);
+		_transfer_time += routes->at(from, nextStation).transferTime;
 		from = nextStation;
 		nextStation = getNextStation(from, to, -1);
 	}
 	return from;
 }
 
+// Sets 0 and 1 are the fields of the current routes (repaired for the closures), the others are
+// loaded by the routing index, from the routes as loaded
+void Simulation::updateSlice() {
+	if (!routingIndex)
+		return;
+	slice = routingIndex->find(time);
+	sliceEnd = routingIndex->sliceEnd(slice);
+	sliceRoutes = policyRoutes(routingIndex->slice(slice).policySet, slicePeak);
+}
+
+const RouteTable* Simulation::policyRoutes(int set, bool& peak) {
+	if (set < 2) {
+		peak = (set == 0);
+		return routes.get();
+	}
+	peak = true;
+	return routingIndex->policySet(set, loadedRoutes ? *loadedRoutes : *routes);
+}
+
+// Precompute getRealStation() for each two stations and both policy sets: the same walk through
+// the transfer stations, done once. If a random choice (more than one policy) is needed on the
+// way, or there is no path, the closure is left as -1 and getRealStation() will walk at runtime,
+// so the random numbers are drawn just as before.
+// A compressed table gets its closures row by row, so they are never expanded.
+void RouteTable::buildClosure() {
+	if (isCompressed()) {
+		std::vector<TransferClosure> row(numStations);
+		for (int set = 0; set < 2; set++) {
+			compactClosures[set].clear();
+			for (int start = 0; start < numStations; start++) {
+				for (int to = 0; to < numStations; to++)
+					row[to] = walkClosure(start, to, set == 0);
+				compactClosures[set].appendRow(row.data(), numStations, sameClosure);
+			}
+		}
+		return;
+	}
+	closures.assign(size_t(numStations) * numStations * 2, TransferClosure());
+	for (int to = 0; to < numStations; to++) {
+		for (int set = 0; set < 2; set++) {
+			for (int start = 0; start < numStations; start++)
+				closures[(size_t(start) * numStations + to) * 2 + set] = walkClosure(start, to, set == 0);
+		}
+	}
+}
+
+// the walk from a station to a destination only depends on the policies to it on the way. Only
+// the closures which differ are written, so a compressed table has just those runs changed
+void RouteTable::buildClosure(std::vector<std::pair<int, int>> cells) {
+	std::sort(cells.begin(), cells.end());
+	cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+	for (int set = 0; set < 2; set++) {
+		std::vector<RunCell<TransferClosure>> changed;
+		for (auto iter = cells.cbegin(); iter != cells.cend(); iter++) {
+			TransferClosure walked = walkClosure(iter->first, iter->second, set == 0);
+			if (!sameClosure(walked, closure(iter->first, iter->second, set == 0))) {
+				RunCell<TransferClosure> cell = { iter->first, iter->second, walked };
+				changed.push_back(cell);
+			}
+		}
+		if (!isCompressed()) {
+			for (auto iter = changed.cbegin(); iter != changed.cend(); iter++)
+				closures[(size_t(iter->row) * numStations + iter->col) * 2 + set] = iter->value;
+		}
+		else
+			compactClosures[set].setCells(changed, numStations, sameClosure);
+	}
+}
+
+TransferClosure RouteTable::walkClosure(int start, int to, bool peak) const {
+	TransferClosure closure;
+	closure.realStation = -1;
+	closure.direction = -1;
+	closure.transferTime = 0.0;
+
+	// the same as getNextStation(from, to, -1), -1 if it is random
+	auto nextOf = [this, peak, to](int from) {
+		if (from == to)
+			return from;
+		const RouteEntry& route = at(from, to);
+		if (route.policy_num != 1)
+			return -1;
+		return peak ? route.policy[0] : route.policy_offpeak[0];
+	};
+
+	int from = start;
+	double transfer_time = 0.0;
+	int nextStation = nextOf(from);
+	int steps = 0;
+	while (nextStation >= 0 && nextStation < numStations && at(from, nextStation).transferTime != -1 \
+		&& steps < numStations) {
+		transfer_time += at(from, nextStation).transferTime;
+		from = nextStation;
+		nextStation = nextOf(from);
+		steps++;
+	}
+	if (nextStation < 0 || nextStation >= numStations || steps >= numStations)
+		return closure;
+
+	closure.realStation = from;
+	closure.transferTime = transfer_time;
+	if (from != to)
+		closure.direction = at(from, nextStation).direction;
+	return closure;
+}
+
 double Simulation::getNextArrivalTime(int trainID) {
 	double NAT = arrivalTime[trainID][time_iter[trainID]];
 	time_iter[trainID]++;
@@ -116,10 +239,20 @@ Report Simulation::report() {
 	result.totalTravelTime = totalTravelTime;
 	result.numArrived = num_arrived;
 	result.numDeparted = num_departed;
+	result.stats = getStats();
 
 	return result;
 }
 
+const SimStats* Simulation::getStats() {
+#if SIM_STATS
+	stats.counters[STAT_HEAP_HIGH_WATER] = (long long)EventQueue->highWater;
+	return &stats;
+#else
+	return NULL;
+#endif
+}
+
 // get the delay contributed by a station (a direction)
 double Simulation::getStationDelay(int stationID, int direction) {
 	return stations[stationID].delay[direction];
@@ -137,6 +270,44 @@ double Simulation::getTime() {
 	return time;
 }
 
+bool Simulation::hasEvents() {
+	return !EventQueue->empty();
+}
+
+int Simulation::getTrainNum() {
+	return totalTrainNum;
+}
+
+// fill the state in one pass instead of one call for each element,
+// return the number of stations exported
+int Simulation::exportState(const StateBuffer& buffer, const StateLayout& layout) {
+	int n = (layout.stations == NULL) ? numStations : layout.numStations;
+	for (int i = 0; i < n; i++) {
+		int stationID = (layout.stations == NULL) ? i : layout.stations[i];
+		if (stationID < 0 || stationID >= numStations) {
+			cout << "station " << stationID << " not existing!\n";
+			throw "Invalid station in the layout!";
+		}
+		const Station& station = stations[stationID];
+		for (int direction = 0; direction < 2; direction++) {
+			if (buffer.queueSize != NULL)
+				buffer.queueSize[2 * i + direction] = station.queueSize[direction];
+			if (buffer.delay != NULL)
+				buffer.delay[2 * i + direction] = station.delay[direction];
+			if (buffer.numPass != NULL)
+				buffer.numPass[2 * i + direction] = station.numPass[direction];
+		}
+	}
+
+	if (buffer.trainLoad != NULL) {
+		for (int i = 0; i < totalTrainNum; i++)
+			buffer.trainLoad[i] = trains[i].passengerNum;
+	}
+	if (buffer.time != NULL)
+		*buffer.time = time;
+	return n;
+}
+
 // the function of Report
 void Report::show() {
 	if (isFinished)
@@ -148,5 +319,143 @@ void Report::show() {
 	cout << "# passenger departed:\t\t" << numDeparted << "\n";
 	cout << "# passenger arrived:\t\t" << numArrived << "\n";
 	cout << "average travel time (min):\t" << totalTravelTime / double(numDeparted * 60) << endl;
+	if (stats != NULL)
+		stats->show();
+}
+
+void SimStats::clear(int numStations) {
+	for (int i = 0; i < NUM_STAT_COUNTERS; i++)
+		counters[i] = 0;
+	queueHistogram.assign(size_t(numStations) * 2 * STAT_QUEUE_BUCKETS, 0);
+}
+
+void SimStats::show() const {
+	const char* names[NUM_STAT_COUNTERS] = { "ARRIVAL events", "SUSPEND events", "NEW_OD events", "ARRIVAL cycles", \
+		"SUSPEND cycles", "NEW_OD cycles", "transfer ODs", "transfer re-pushes", "heap high-water", \
+		"getRealStation walks", "getRealStation steps" };
+	for (int i = 0; i < NUM_STAT_COUNTERS; i++) {
+		cout << names[i] << ":" << string(32 - strlen(names[i]), ' ') << counters[i];
+		if (i >= STAT_ARRIVAL_CYCLES && i <= STAT_NEW_OD_CYCLES && counters[i - STAT_ARRIVAL_CYCLES] > 0)
+			cout << "\t(" << counters[i] / counters[i - STAT_ARRIVAL_CYCLES] << " per event)";
+		cout << "\n";
+	}
+
+	// the histogram of all the queues, and the queue with the longest length seen
+	long long all[STAT_QUEUE_BUCKETS] = { 0 };
+	int longest = -1, longestBucket = -1;
+	for (size_t i = 0; i < queueHistogram.size(); i++) {
+		int bucket = int(i % STAT_QUEUE_BUCKETS);
+		all[bucket] += queueHistogram[i];
+		if (queueHistogram[i] > 0 && bucket > longestBucket) {
+			longestBucket = bucket;
+			longest = int(i / STAT_QUEUE_BUCKETS);
+		}
+	}
+	cout << "queue length at arrivals:\t";
+	for (int bucket = 0; bucket < STAT_QUEUE_BUCKETS; bucket++)
+		cout << ((bucket == 0) ? 0 : (1 << (bucket - 1))) << ":" << all[bucket] << " ";
+	cout << "\n";
+	if (longestBucket > 0)
+		cout << "longest queue:\t\t\tstation " << longest / 2 << " direction " << longest % 2 << ", " \
+			<< (1 << (longestBucket - 1)) << " or more\n";
+}
+
+
+#define MIN_RING_SIZE 4		// the size of a new ring, must be a power of 2
+
+void PassengerQueues::reset(int numQueues) {
+	if (int(rings.size()) != numQueues) {
+		Ring empty = { 0, MIN_RING_SIZE - 1, 0, 0 };
+		rings.assign(numQueues, empty);
+	}
+
+	// lay out the rings one after another, dropping the space left by the moved rings
+	unsigned int offset = 0;
+	for (auto iter = rings.begin(); iter != rings.end(); iter++) {
+		iter->offset = offset;
+		iter->head = 0;
+		iter->count = 0;
+		offset += iter->mask + 1;
+	}
+	arena.resize(offset);
+}
+
+void PassengerQueues::push(int q, int destination, int num) {
+	Ring& ring = rings[q];
+	if (ring.count > 0) {
+		WaitingPassengers& last = arena[ring.offset + ((ring.head + ring.count - 1) & ring.mask)];
+		if (last.destination == destination) {
+			last.numPassengers += num;
+			return;
+		}
+	}
+	if (ring.count > ring.mask)
+		grow(q);
+
+	WaitingPassengers& passengers = arena[rings[q].offset + ((rings[q].head + rings[q].count) & rings[q].mask)];
+	passengers.destination = destination;
+	passengers.numPassengers = num;
+	rings[q].count++;
+}
+
+void PassengerQueues::assign(int q, const PassengerQueues& other) {
+	const Ring& from = other.rings[q];
+	rings[q].head = 0;
+	rings[q].count = 0;
+	for (unsigned int i = 0; i < from.count; i++) {
+		const WaitingPassengers& passengers = other.arena[from.offset + ((from.head + i) & from.mask)];
+		push(q, passengers.destination, passengers.numPassengers);
+	}
+}
+
+// move the ring to the end of the arena with double size, the groups are put in order from 0
+void PassengerQueues::grow(int q) {
+	Ring& ring = rings[q];
+	unsigned int size = ring.mask + 1;
+	unsigned int offset = (unsigned int)arena.size();
+	arena.resize(arena.size() + 2 * size);
+	for (unsigned int i = 0; i < ring.count; i++)
+		arena[offset + i] = arena[ring.offset + ((ring.head + i) & ring.mask)];
+	ring.offset = offset;
+	ring.mask = 2 * size - 1;
+	ring.head = 0;
 }
 
+int Destinations::find(int station) const {
+	int low = 0, high = int(slots.size());
+	while (low < high) {
+		int mid = (low + high) / 2;
+		if (slots[mid].station < station)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low;
+}
+
+void Destinations::add(int station, int num) {
+	if (num <= 0)
+		return;
+	int i = find(station);
+	if (i < size() && slots[i].station == station) {
+		if (slots[i].num + num > 0xFFFF)
+			throw "Too many passengers heading for one station on a train!";
+		slots[i].num += num;
+	}
+	else {
+		if (station > 0xFFFF || num > 0xFFFF)
+			throw "Too many stations or passengers for a train!";
+		Slot slot = { (unsigned short)station, (unsigned short)num };
+		slots.insert(slots.begin() + i, slot);
+	}
+}
+
+int Destinations::take(int station) {
+	int i = find(station);
+	if (i < size() && slots[i].station == station) {
+		int num = slots[i].num;
+		slots.erase(slots.begin() + i);
+		return num;
+	}
+	return 0;
+}
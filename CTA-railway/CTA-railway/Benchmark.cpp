@@ -0,0 +1,197 @@
+//Header Files
+#include "util.hpp"
+#include "Benchmark.hpp"
+#include "DataCache.hpp"
+#include <chrono>
+#include <stdio.h>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#include <process.h>
+#pragma comment(lib, "psapi.lib")
+#define getpid _getpid
+#else
+#include <unistd.h>
+#ifdef __APPLE__
+#include <mach/mach.h>
+#endif
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start) {
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// the value at 'fraction' of the sorted samples, the nearest rank
+static double percentile(std::vector<double> samples, double fraction) {
+	if (samples.empty())
+		return 0.0;
+	std::sort(samples.begin(), samples.end());
+	size_t rank = size_t(ceil(fraction * samples.size()));
+	return samples[(rank > 0) ? rank - 1 : 0];
+}
+
+// the resident memory of the process now in MB, 0 if it can't be read
+static double getCurrentRSS() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0.0;
+	return counters.WorkingSetSize / (1024.0 * 1024.0);
+#elif defined(__APPLE__)
+	mach_task_basic_info_data_t info;
+	mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+	if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS)
+		return 0.0;
+	return info.resident_size / (1024.0 * 1024.0);
+#else
+	FILE* file = fopen("/proc/self/statm", "r");
+	if (file == NULL)
+		return 0.0;
+	long long size = 0, resident = 0;
+	int numRead = fscanf(file, "%lld %lld", &size, &resident);
+	fclose(file);
+	if (numRead != 2)
+		return 0.0;
+	return resident * double(sysconf(_SC_PAGESIZE)) / (1024.0 * 1024.0);
+#endif
+}
+
+// a file of this process in the temporary directory, for the data cache
+static string temporaryCacheName() {
+#ifdef _WIN32
+	char dir[MAX_PATH + 1];
+	DWORD length = GetTempPathA(MAX_PATH + 1, dir);
+	string path = (length > 0 && length <= MAX_PATH) ? string(dir) : string(".\\");
+#else
+	const char* dir = getenv("TMPDIR");
+	string path = string((dir != NULL && *dir != '\0') ? dir : "/tmp") + "/";
+#endif
+	return path + "cta-benchmark-" + std::to_string((long long)getpid()) + ".cache";
+}
+
+BenchmarkResult runBenchmark(const std::string& dataDir, int repeats) {
+	BenchmarkResult result;
+	result.dataDir = dataDir;
+	result.numStations = 0;
+	result.numTrains = 0;
+	result.repeats = std::max(repeats, 1);
+	result.initCsvTime = result.initCacheTime = result.resetTime = result.dayRunTime = 0.0;
+	result.cached = true;
+	result.numEvents = 0;
+	result.eventsPerSecond = 0.0;
+	result.numSteps = 0;
+	result.stepP50 = result.stepP99 = 0.0;
+	result.routeMemory = 0.0;
+	result.compressedRoutes = false;
+	result.rss = 0.0;
+
+	std::vector<double> initCsv, initCache, reset, dayRun, steps;
+	string cache_name = temporaryCacheName();
+	try {
+		for (int round = 0; round < result.repeats; round++) {
+			remove(cache_name.c_str());
+			{
+				Simulation sim;
+				Clock::time_point start = Clock::now();
+				sim.init(dataDir, cache_name);
+				initCsv.push_back(secondsSince(start));
+				result.rss = std::max(result.rss, getCurrentRSS());
+			}
+
+			Simulation sim;
+			Clock::time_point start = Clock::now();
+			sim.init(dataDir, cache_name);
+			if (sim.loadedFromCache)
+				initCache.push_back(secondsSince(start));
+			else
+				result.cached = false;		// the cache couldn't be written or read
+			result.rss = std::max(result.rss, getCurrentRSS());
+			result.numStations = sim.numStations;
+			result.numTrains = sim.getTrainNum();
+			result.routeMemory = sim.routes->memoryBytes() / 1048576.0;
+			result.compressedRoutes = sim.routes->isCompressed();
+
+			// a whole day in one run()
+			sim.addEvent(Event(SIMULATION_END_TIME, SUSPEND));
+			start = Clock::now();
+			sim.run();
+			dayRun.push_back(secondsSince(start));
+			result.numEvents = sim.numEvents;
+			result.rss = std::max(result.rss, getCurrentRSS());
+
+			start = Clock::now();
+			sim.reset();
+			reset.push_back(secondsSince(start));
+
+			// the same day in the control steps
+			for (double t = START_TIME; t <= SIMULATION_END_TIME; t += STEP_INTERVAL)
+				sim.addEvent(Event(t, SUSPEND));
+			sim.run();		// to START_TIME
+			while (sim.getTime() < SIMULATION_END_TIME && sim.hasEvents()) {
+				start = Clock::now();
+				sim.run();
+				steps.push_back(secondsSince(start));
+			}
+			result.rss = std::max(result.rss, getCurrentRSS());
+		}
+	}
+	catch (const char* msg) {
+		remove(cache_name.c_str());
+		result.error = msg;
+		return result;
+	}
+	remove(cache_name.c_str());
+
+	result.initCsvTime = percentile(initCsv, 0.5);
+	result.initCacheTime = percentile(initCache, 0.5);
+	result.resetTime = percentile(reset, 0.5);
+	result.dayRunTime = percentile(dayRun, 0.5);
+	if (result.dayRunTime > 0)
+		result.eventsPerSecond = result.numEvents / result.dayRunTime;
+	result.numSteps = int(steps.size());
+	result.stepP50 = percentile(steps, 0.5);
+	result.stepP99 = percentile(steps, 0.99);
+	return result;
+}
+
+// the data directories are paths, escape them for json
+static string jsonString(const string& s) {
+	string escaped = "\"";
+	for (size_t i = 0; i < s.size(); i++) {
+		if (s[i] == '"' || s[i] == '\\')
+			escaped += '\\';
+		escaped += s[i];
+	}
+	return escaped + "\"";
+}
+
+bool writeBenchmark(const std::string& file_name, const std::vector<BenchmarkResult>& results) {
+	FILE* file = fopen(file_name.c_str(), "w");
+	if (file == NULL)
+		return false;
+	fprintf(file, "[\n");
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchmarkResult& r = results[i];
+		fprintf(file, "  {\"dataset\": %s, \"ok\": %s, \"error\": %s, \"stations\": %d, \"trains\": %d, \"repeats\": %d,\n", \
+			jsonString(r.dataDir).c_str(), r.error.empty() ? "true" : "false", jsonString(r.error).c_str(), \
+			r.numStations, r.numTrains, r.repeats);
+		// no cache time if the cache wasn't read every round
+		string initCache = "null";
+		if (r.cached && r.error.empty()) {
+			char number[32];
+			snprintf(number, sizeof(number), "%.6f", r.initCacheTime);
+			initCache = number;
+		}
+		fprintf(file, "   \"init_csv_s\": %.6f, \"init_cache_s\": %s, \"cached\": %s, \"reset_s\": %.6f, \"day_run_s\": %.6f,\n", \
+			r.initCsvTime, initCache.c_str(), r.cached ? "true" : "false", r.resetTime, r.dayRunTime);
+		fprintf(file, "   \"events\": %lld, \"events_per_s\": %.1f, \"steps\": %d, \"step_p50_s\": %.6f, \"step_p99_s\": %.6f,\n", \
+			r.numEvents, r.eventsPerSecond, r.numSteps, r.stepP50, r.stepP99);
+		fprintf(file, "   \"route_mb\": %.3f, \"routes_compressed\": %s, \"rss_mb\": %.1f}%s\n", r.routeMemory, \
+			r.compressedRoutes ? "true" : "false", r.rss, (i + 1 < results.size()) ? "," : "");
+	}
+	fprintf(file, "]\n");
+	return fclose(file) == 0;
+}
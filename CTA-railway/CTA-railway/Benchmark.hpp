@@ -0,0 +1,45 @@
+#pragma once
+#include "Simulation.hpp"
+
+// Measure the speed of the simulator on some data sets, to compare the builds with each other.
+// For each data set:
+//	init		Simulation::init() from the csv files, writing the data cache into a temporary
+//				file (the one in the data directory is left alone), and again from that cache
+//	reset		Simulation::reset() after a full day
+//	day run		one run() from the reset to SIMULATION_END_TIME, and the events handled per second
+//	step		the latency of each run() between two suspends STEP_INTERVAL apart, from START_TIME
+//				to SIMULATION_END_TIME, like the control steps of the RL model
+//	routes		the memory of the route table and the transfer closures, and if it is compressed
+//	RSS			the largest resident memory of the process sampled while the simulators of the
+//				data set are alive (after each init and run). not the peak of the process, which
+//				would keep the largest of the data sets before (the allocator may still hold a
+//				little of what they freed)
+// The times of 'repeats' rounds are summarized by the median (the percentiles for the steps).
+#define STEP_INTERVAL 900.0		// 15 min
+
+struct BenchmarkResult {
+	std::string dataDir;
+	std::string error;		// why the data set can't be run, empty if it's measured
+	int numStations;
+	int numTrains;
+	int repeats;
+	double initCsvTime;		// sec
+	double initCacheTime;	// sec, if 'cached'
+	bool cached;			// if the second init() read the cache the first one wrote
+	double resetTime;		// sec
+	double dayRunTime;		// sec
+	long long numEvents;	// the events of a day
+	double eventsPerSecond;
+	int numSteps;			// the steps measured, of all the rounds
+	double stepP50;			// sec
+	double stepP99;			// sec
+	double routeMemory;		// MB
+	bool compressedRoutes;
+	double rss;				// MB
+};
+
+BenchmarkResult runBenchmark(const std::string& dataDir, int repeats);
+
+// write the results as a json array, one object for each data set, the times in seconds.
+// return false if the file can't be written
+bool writeBenchmark(const std::string& file_name, const std::vector<BenchmarkResult>& results);
@@ -0,0 +1,339 @@
+//Header Files
+#include "util.hpp"
+#include "Simulation.hpp"
+#include "DataCache.hpp"
+#include <cstring>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <process.h>
+#define getpid _getpid
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+const char* DATA_FILES[NUM_DATA_FILES] = {
+	"arrivalStationID.csv",
+	"arrivalTime.csv",
+	"directions.csv",
+	"policy.csv",
+	"policy2.csv",
+	"policy_num.csv",
+	"startTrainInfo.csv",
+	"stations.csv",
+	"transferTime.csv",
+	"fixedOD.csv"
+};
+
+static const char CACHE_MAGIC[8] = { 'C', 'T', 'A', 'C', 'A', 'C', 'H', 'E' };
+
+bool getFileStamp(const char* file_name, long long& size, long long& mtime) {
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA info;
+	if (!GetFileAttributesExA(file_name, GetFileExInfoStandard, &info))
+		return false;
+	size = ((long long)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+	// 100 ns since 1601, only compared with itself
+	mtime = (((long long)info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime) * 100;
+#else
+	struct stat st;
+	if (stat(file_name, &st) != 0)
+		return false;
+	size = (long long)st.st_size;
+#ifdef __APPLE__
+	mtime = (long long)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+	mtime = (long long)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+#endif
+	return true;
+}
+
+void getSourceStamp(const char* file_name, long long& size, long long& mtime) {
+	if (!getFileStamp(file_name, size, mtime)) {
+		size = ABSENT_FILE_SIZE;
+		mtime = 0;
+	}
+}
+
+bool MappedFile::open(const std::string& file_name) {
+	close();
+#ifdef _WIN32
+	HANDLE file = CreateFileA(file_name.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, \
+		FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+		CloseHandle(file);
+		return false;
+	}
+	HANDLE map = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (map == NULL) {
+		CloseHandle(file);
+		return false;
+	}
+	const void* view = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+	if (view == NULL) {
+		CloseHandle(map);
+		CloseHandle(file);
+		return false;
+	}
+	handle = file;
+	mapping = map;
+	data = (const char*)view;
+	size = (size_t)fileSize.QuadPart;
+#else
+	int fd = ::open(file_name.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+	void* view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);	// the mapping stays valid after the file is closed
+	if (view == MAP_FAILED)
+		return false;
+	data = (const char*)view;
+	size = (size_t)st.st_size;
+#endif
+	return true;
+}
+
+void MappedFile::close() {
+	if (data == NULL)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+	CloseHandle((HANDLE)mapping);
+	CloseHandle((HANDLE)handle);
+#else
+	munmap((void*)data, size);
+#endif
+	data = NULL;
+	size = 0;
+	handle = NULL;
+	mapping = NULL;
+}
+
+// the helpers to write/read the image, the matrices of different row lengths are stored as
+// [long long rows][int length of each row][all the elements row by row]
+template <typename T>
+static void writeArray(ofstream& file, const T* data, size_t n) {
+	file.write((const char*)data, n * sizeof(T));
+}
+
+template <typename T>
+static void writeMatrix(ofstream& file, const std::vector<std::vector<T>>& mat) {
+	long long rows = (long long)mat.size();
+	writeArray(file, &rows, 1);
+	for (auto iter_row = mat.cbegin(); iter_row != mat.cend(); iter_row++) {
+		int length = int(iter_row->size());
+		writeArray(file, &length, 1);
+	}
+	for (auto iter_row = mat.cbegin(); iter_row != mat.cend(); iter_row++)
+		writeArray(file, iter_row->data(), iter_row->size());
+}
+
+// [long long length][the elements]
+template <typename T>
+static void writeVector(ofstream& file, const std::vector<T>& vec) {
+	long long length = (long long)vec.size();
+	writeArray(file, &length, 1);
+	writeArray(file, vec.data(), vec.size());
+}
+
+// a cursor going through the mapped image, every read checks the bounds
+struct CacheReader {
+	const char* pos;
+	const char* end;
+
+	template <typename T>
+	bool read(T* data, size_t n) {
+		size_t bytes = n * sizeof(T);
+		if (size_t(end - pos) < bytes)
+			return false;
+		memcpy(data, pos, bytes);
+		pos += bytes;
+		return true;
+	}
+
+	template <typename T>
+	bool readMatrix(std::vector<std::vector<T>>& mat) {
+		long long rows;
+		if (!read(&rows, 1) || rows < 0 || size_t(end - pos) / sizeof(int) < size_t(rows))
+			return false;
+		std::vector<int> lengths((size_t)rows);
+		if (!read(lengths.data(), lengths.size()))
+			return false;
+		mat.clear();
+		mat.resize(size_t(rows));
+		for (size_t i = 0; i < mat.size(); i++) {
+			if (lengths[i] < 0)
+				return false;
+			mat[i].resize(lengths[i]);
+			if (!read(mat[i].data(), mat[i].size()))
+				return false;
+		}
+		return true;
+	}
+
+	template <typename T>
+	bool readVector(std::vector<T>& vec) {
+		long long length;
+		if (!read(&length, 1) || length < 0 || size_t(end - pos) / sizeof(T) < size_t(length))
+			return false;
+		vec.resize(size_t(length));
+		return read(vec.data(), vec.size());
+	}
+};
+
+// the runs of a compressed route table, checked so that no query can go out of them
+static bool readRuns(CacheReader& reader, RunMatrix<RouteEntry>& matrix, int numStations) {
+	if (!reader.readVector(matrix.rowStart) || !reader.readVector(matrix.firstCol) || !reader.readVector(matrix.values))
+		return false;
+	if (int(matrix.rowStart.size()) != numStations + 1 || matrix.rowStart[0] != 0 || \
+		matrix.rowStart[numStations] != int(matrix.firstCol.size()) || matrix.values.size() != matrix.firstCol.size())
+		return false;
+	for (int row = 0; row < numStations; row++) {
+		// each row starts at column 0, with the runs in order
+		int begin = matrix.rowStart[row], end = matrix.rowStart[row + 1];
+		if (end <= begin || matrix.firstCol[begin] != 0)
+			return false;
+		for (int k = begin + 1; k < end; k++) {
+			if (matrix.firstCol[k] <= matrix.firstCol[k - 1] || matrix.firstCol[k] >= numStations)
+				return false;
+		}
+	}
+	return true;
+}
+
+// write all the loaded tables into the image (usually in the data directory), with the stamps of the
+// csv files (an optional file that isn't there is stamped as absent, so adding it later makes
+// the image stale). the layout: header, stations, route table (one block, or the rowStart, firstCol and
+// values of the runs if compressed), startTrainInfo, arrivalTime, arrivalStationID, fixedOD
+void Simulation::saveCache(const string& dataDir, const string& file_name) {
+	CacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.version = DATA_CACHE_VERSION;
+	header.numStations = numStations;
+	header.maxPolicyNum = MAX_POLICY_NUM;
+	header.entrySize = sizeof(RouteEntry);
+	header.compressedRoutes = routes->isCompressed() ? 1 : 0;
+	for (int i = 0; i < NUM_DATA_FILES; i++)
+		getSourceStamp((dataDir + "/" + DATA_FILES[i]).c_str(), header.sourceSize[i], header.sourceTime[i]);
+
+	// write to a temporary file first, so that a broken image is never used. the name is
+	// the process' own, so two processes writing the image at once don't mix their files
+	string temp_name = file_name + "." + std::to_string((long long)getpid()) + ".tmp";
+	ofstream file(temp_name, ios::binary | ios::trunc);
+	if (!file) {
+		cout << "can't write the data cache " << file_name << "\n";
+		return;
+	}
+	writeArray(file, &header, 1);
+
+	std::vector<std::vector<int>> stationInfo;
+	for (auto iter = stations.cbegin(); iter != stations.cend(); iter++) {
+		std::vector<int> info = { iter->ID, iter->lineID, iter->isTerminal[0], iter->isTerminal[1], iter->isTransfer };
+		stationInfo.push_back(info);
+	}
+	writeMatrix(file, stationInfo);
+	if (routes->isCompressed()) {
+		RunMatrix<RouteEntry>& matrix = routes->compressedEntries();
+		writeVector(file, matrix.rowStart);
+		writeVector(file, matrix.firstCol);
+		writeVector(file, matrix.values);
+	}
+	else
+		file.write((const char*)routes->data(), routes->bytes());
+
+	writeMatrix(file, startTrainInfo);
+	writeMatrix(file, arrivalTime);
+	writeMatrix(file, arrivalStationID);
+	writeMatrix(file, fixedOD);
+	file.close();
+	if (!file) {
+		cout << "can't write the data cache " << file_name << "\n";
+		remove(temp_name.c_str());
+		return;
+	}
+
+	remove(file_name.c_str());
+	if (rename(temp_name.c_str(), file_name.c_str()) != 0) {
+		cout << "can't write the data cache " << file_name << "\n";
+		remove(temp_name.c_str());
+	}
+}
+
+// load all the tables from the image of the data directory, return false if the image doesn't
+// exist or is stale, then the tables should be loaded from the csv files.
+bool Simulation::loadCache(const string& dataDir, const string& file_name) {
+	MappedFile image;
+	if (!image.open(file_name))
+		return false;
+
+	CacheHeader header;
+	CacheReader reader = { image.data, image.data + image.size };
+	if (!reader.read(&header, 1))
+		return false;
+	if (memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || header.version != DATA_CACHE_VERSION || \
+		header.maxPolicyNum != MAX_POLICY_NUM || header.entrySize != int(sizeof(RouteEntry)) || header.numStations < 0)
+		return false;
+	for (int i = 0; i < NUM_DATA_FILES; i++) {
+		long long size, mtime;
+		getSourceStamp((dataDir + "/" + DATA_FILES[i]).c_str(), size, mtime);
+		if (size != header.sourceSize[i] || mtime != header.sourceTime[i])
+			return false;
+	}
+
+	cout << "Reading cache";
+	std::vector<std::vector<int>> stationInfo;
+	bool ok = reader.readMatrix(stationInfo) && int(stationInfo.size()) == header.numStations;
+	for (auto iter_row = stationInfo.cbegin(); ok && iter_row != stationInfo.cend(); iter_row++)
+		ok = (iter_row->size() == 5);
+
+	// the route table is copied in one go, or run by run
+	std::shared_ptr<RouteTable> table;
+	if (ok && header.compressedRoutes) {
+		table = std::make_shared<RouteTable>(header.numStations, true);
+		ok = readRuns(reader, table->compressedEntries(), header.numStations);
+	}
+	else if (ok) {
+		table = std::make_shared<RouteTable>(header.numStations);
+		ok = (size_t(reader.end - reader.pos) >= table->bytes());
+		if (ok) {
+			memcpy((void*)table->data(), reader.pos, table->bytes());
+			reader.pos += table->bytes();
+		}
+	}
+
+	ok = ok && reader.readMatrix(startTrainInfo) && reader.readMatrix(arrivalTime) && \
+		reader.readMatrix(arrivalStationID) && reader.readMatrix(fixedOD);
+	if (!ok) {
+		cout << "broken!\n";
+		startTrainInfo.clear();
+		arrivalTime.clear();
+		arrivalStationID.clear();
+		fixedOD.clear();
+		return false;
+	}
+
+	stations.clear();
+	for (auto iter_row = stationInfo.cbegin(); iter_row != stationInfo.cend(); iter_row++) {
+		const std::vector<int>& info = *iter_row;
+		Station newStation(info[0], info[1], info[2] != 0, info[3] != 0, info[4] != 0);
+		stations.push_back(newStation);
+	}
+	numStations = header.numStations;
+	routes = table;
+	cout << "done\n";
+	return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// The binary image of all the tables loaded by Simulation::init(). It is written once
+// after the csv files are read, and is memory-mapped and copied into the tables on the
+// following starts, so there is no text to parse. If any of the csv files is changed
+// (size or modification time in nanoseconds, or added/removed), or the version/size
+// constants change, the image is considered stale and the csv files are read again.
+#define DATA_CACHE_FILE "data.cache"	// in the data directory
+#define DATA_CACHE_VERSION 4
+#define ABSENT_FILE_SIZE -1		// the size stamped for an optional csv file that isn't there
+#define NUM_DATA_FILES 10
+
+// the csv files (in the data directory) the image is compiled from, in the order of the stamps
+// in the header
+extern const char* DATA_FILES[NUM_DATA_FILES];
+
+struct CacheHeader {
+	char magic[8];				// "CTACACHE"
+	int version;				// DATA_CACHE_VERSION
+	int numStations;			// the number of stations, the route table has numStations^2 entries
+	int maxPolicyNum;			// MAX_POLICY_NUM when the image was written
+	int entrySize;				// sizeof(RouteEntry) when the image was written
+	int compressedRoutes;		// 1 if the route table is stored as the runs of RunMatrix, 0 as one block
+	long long sourceSize[NUM_DATA_FILES];	// size of each csv file, ABSENT_FILE_SIZE if it doesn't exist
+	long long sourceTime[NUM_DATA_FILES];	// modification time of each csv file (ns), 0 if it doesn't exist
+};
+
+// read-only memory mapping of a whole file
+class MappedFile {
+public:
+	MappedFile() : data(NULL), size(0), handle(NULL), mapping(NULL) {}
+	~MappedFile() { close(); }
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const std::string& file_name);	// return false if the file can't be mapped
+	void close();
+
+	const char* data;
+	size_t size;
+
+private:
+	void* handle;	// the file handle on Windows, unused elsewhere
+	void* mapping;	// the mapping handle on Windows, unused elsewhere
+};
+
+// get the size and modification time (ns) of a file, return false if the file doesn't exist
+bool getFileStamp(const char* file_name, long long& size, long long& mtime);
+// the same, but an absent file gets the stamp (ABSENT_FILE_SIZE, 0)
+void getSourceStamp(const char* file_name, long long& size, long long& mtime);
@@ -0,0 +1,181 @@
+//Header Files
+#include "EventLog.hpp"
+#include <chrono>
+#include <cstring>
+
+static const char LOG_MAGIC[8] = { 'C', 'T', 'A', 'L', 'O', 'G', 0, 0 };
+
+EventLog::EventLog() : ring(LOG_RING_SIZE), tail(0), head(0), numDropped(0), file(NULL), stopping(false) {
+	for (size_t i = 0; i < ring.size(); i++)
+		ring[i].seq.store(i, std::memory_order_relaxed);
+	writer = std::thread(&EventLog::work, this);
+}
+
+EventLog::~EventLog() {
+	stopping = true;
+	wake.notify_one();
+	if (writer.joinable())
+		writer.join();
+	close();
+}
+
+bool EventLog::log(int code, double time, int station, int train, int count, double value) {
+	// take a position, the slot is free when its seq is the position (the writer has read it
+	// a round ago), full if it is still a round behind
+	size_t pos = tail.load(std::memory_order_relaxed);
+	Slot* slot;
+	while (true) {
+		slot = &ring[pos & (LOG_RING_SIZE - 1)];
+		size_t seq = slot->seq.load(std::memory_order_acquire);
+		intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+		if (diff == 0) {
+			if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if (diff < 0) {
+			numDropped++;
+			return false;
+		}
+		else
+			pos = tail.load(std::memory_order_relaxed);
+	}
+	LogRecord record = { time, value, station, train, count, code };
+	slot->record = record;
+	slot->seq.store(pos + 1, std::memory_order_release);
+	return true;
+}
+
+// called with 'mtx' held
+size_t EventLog::drain() {
+	size_t pos = head.load(std::memory_order_relaxed);
+	size_t n = 0;
+	while (true) {
+		Slot& slot = ring[pos & (LOG_RING_SIZE - 1)];
+		if (slot.seq.load(std::memory_order_acquire) != pos + 1)
+			break;
+		LogRecord record = slot.record;
+		slot.seq.store(pos + LOG_RING_SIZE, std::memory_order_release);
+		pos++;
+		n++;
+		if (file != NULL)
+			fwrite(&record, sizeof(record), 1, file);
+		else
+			formatRecord(std::cout, record);
+	}
+	head.store(pos, std::memory_order_release);
+	return n;
+}
+
+void EventLog::work() {
+	std::unique_lock<std::mutex> lock(mtx);
+	while (true) {
+		if (drain() > 0)
+			drained.notify_all();
+		if (stopping)
+			return;
+		// log() doesn't wake the writer (that would need the lock), so look again a bit later
+		wake.wait_for(lock, std::chrono::milliseconds(LOG_WRITE_INTERVAL));
+	}
+}
+
+void EventLog::flush() {
+	size_t target = tail.load(std::memory_order_acquire);
+	std::unique_lock<std::mutex> lock(mtx);
+	while (head.load(std::memory_order_acquire) < target) {
+		wake.notify_one();
+		drained.wait_for(lock, std::chrono::milliseconds(LOG_WRITE_INTERVAL));
+	}
+	if (file != NULL)
+		fflush(file);
+	else
+		std::cout.flush();
+}
+
+bool EventLog::open(const std::string& file_name) {
+	std::lock_guard<std::mutex> lock(mtx);
+	drain();	// the records before go where they were going
+	if (file != NULL)
+		fclose(file);
+	file = fopen(file_name.c_str(), "wb");
+	if (file == NULL)
+		return false;
+	LogFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, LOG_MAGIC, sizeof(LOG_MAGIC));
+	header.version = LOG_FILE_VERSION;
+	header.recordSize = sizeof(LogRecord);
+	fwrite(&header, sizeof(header), 1, file);
+	return true;
+}
+
+void EventLog::close() {
+	std::lock_guard<std::mutex> lock(mtx);
+	drain();
+	if (file != NULL)
+		fclose(file);
+	file = NULL;
+}
+
+// never freed, joining the writer while a dll is unloaded can hang, so flush() or close()
+// it before exit instead
+EventLog& eventLog() {
+	static EventLog* log = new EventLog();
+	return *log;
+}
+
+void formatRecord(std::ostream& out, const LogRecord& record) {
+	switch (record.code) {
+	case LOG_TIME_ERROR:
+		out << "ERROR: time error!\n";
+		out << "last time: " << record.value << "\n";
+		out << "current time: " << record.time << "\n";
+		break;
+	case LOG_WAIT_TIME_ERROR:
+		out << "ERROR: time error!\n";
+		break;
+	case LOG_NOT_CLEARED_TEMPORARY:
+		out << record.count << " passengers not cleared at temperary terminal " << record.station << "!\n";
+		break;
+	case LOG_NOT_CLEARED_TERMINAL:
+		out << "ERROR: " << record.count << " passengers not cleared at fixed terminal station " << record.station << "!\n";
+		break;
+	case LOG_ILLEGAL_OD:
+		out << "illegal OD pair from " << record.station << " to " << int(record.value) << " at time " << record.time << "!\n";
+		break;
+	case LOG_EMPTY_QUEUE:
+		out << "Empty Queue!\n";
+		break;
+	default:
+		out << "unknown log code " << record.code << " at time " << record.time << "\n";
+	}
+}
+
+long long readLog(const std::string& file_name, std::ostream& out, bool csv) {
+	FILE* file = fopen(file_name.c_str(), "rb");
+	if (file == NULL)
+		return -1;
+	LogFileHeader header;
+	if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, LOG_MAGIC, sizeof(LOG_MAGIC)) != 0 || \
+		header.version != LOG_FILE_VERSION || header.recordSize != int(sizeof(LogRecord))) {
+		fclose(file);
+		return -1;
+	}
+
+	if (csv)
+		out << "time,code,station,train,count,value\n";
+	long long n = 0;
+	LogRecord records[1024];
+	size_t num;
+	while ((num = fread(records, sizeof(LogRecord), 1024, file)) > 0) {
+		for (size_t i = 0; i < num; i++) {
+			const LogRecord& r = records[i];
+			if (csv)
+				out << r.time << "," << r.code << "," << r.station << "," << r.train << "," << r.count << "," << r.value << "\n";
+			else
+				formatRecord(out, r);
+		}
+		n += num;
+	}
+	fclose(file);
+	return n;
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+// The diagnostics of the simulators (the passengers left on a train at its terminal, the time
+// errors...). Simulation::run() only puts a small record into a lock-free ring, a background
+// thread takes them out and writes them to the binary log file given to open(), or as the old
+// text to cout when no file is open. So the event loop never waits for the console or the disk,
+// and several simulators on several threads can log at once. If the ring is full the record is
+// dropped and counted, run() never waits for the writer.
+// The file is LogFileHeader followed by the records as they are in memory, see readLog().
+#define LOG_RING_SIZE 65536		// records, must be a power of 2
+#define LOG_WRITE_INTERVAL 20	// ms, how often the writer looks into the ring
+#define LOG_FILE_VERSION 1
+
+// what happened, and what the fields of the record mean
+enum LogCode {
+	LOG_TIME_ERROR,				// an event before the last one, value = the last time
+	LOG_WAIT_TIME_ERROR,		// the average waiting start at 'station' is in the future, value = it
+	LOG_NOT_CLEARED_TEMPORARY,	// 'count' passengers left on 'train' at a temporary terminal 'station'
+	LOG_NOT_CLEARED_TERMINAL,	// 'count' passengers left on 'train' at its fixed terminal 'station'
+	LOG_ILLEGAL_OD,				// 'count' passengers from 'station' to the same station (value)
+	LOG_EMPTY_QUEUE,			// run() found no event
+	NUM_LOG_CODES
+};
+
+struct LogRecord {
+	double time;		// the simulation time
+	double value;		// depends on the code
+	int32_t station;
+	int32_t train;
+	int32_t count;
+	int32_t code;		// LogCode
+};
+
+struct LogFileHeader {
+	char magic[8];		// "CTALOG\0\0"
+	int32_t version;	// LOG_FILE_VERSION
+	int32_t recordSize;	// sizeof(LogRecord)
+};
+
+class EventLog {
+public:
+	EventLog();
+	~EventLog();
+	EventLog(const EventLog&) = delete;
+	EventLog& operator=(const EventLog&) = delete;
+
+	// put a record into the ring, never blocks. return false if it is dropped
+	bool log(int code, double time, int station = -1, int train = -1, int count = 0, double value = 0.0);
+	bool open(const std::string& file_name);	// write the following records into a binary file
+	void close();		// write the records left and go back to the text on cout
+	void flush();		// wait until the records logged so far are written
+	long long dropped() { return numDropped.load(); }
+
+private:
+	struct Slot {
+		std::atomic<size_t> seq;	// the Vyukov ring: = the position when the slot is free to write,
+		LogRecord record;			// the position + 1 when the record is ready to read
+	};
+
+	std::vector<Slot> ring;
+	std::atomic<size_t> tail;		// the next position to write, taken by the producers with CAS
+	std::atomic<size_t> head;		// the next position to read, only moved by the writer thread
+	std::atomic<long long> numDropped;
+
+	std::mutex mtx;			// for the file and the thread, never taken by log()
+	std::condition_variable wake;		// to wake the writer before its time, by flush()
+	std::condition_variable drained;	// the writer has written some records
+	FILE* file;				// NULL to write the text to cout
+	std::thread writer;
+	std::atomic<bool> stopping;
+
+	void work();			// the writer thread
+	size_t drain();			// write all the ready records, return the number written
+};
+
+// the log shared by all the simulators in the process, the writer starts with the first record
+EventLog& eventLog();
+
+// the text of a record, the same as the simulator used to print
+void formatRecord(std::ostream& out, const LogRecord& record);
+
+// read a binary log and print it as text (or as csv: time,code,station,train,count,value).
+// return the number of records, -1 if it is not a log file
+long long readLog(const std::string& file_name, std::ostream& out, bool csv);
@@ -0,0 +1,594 @@
+//Header Files
+#include "util.hpp"
+#include "Fluid.hpp"
+#include "Scheduler.hpp"
+#include "RoutingIndex.hpp"
+#include <chrono>
+
+// the same as getNextStation(), but the first policy is taken instead of a random one
+static int nextStationOf(const RouteTable& table, bool peak, int from, int to, int lineID, \
+	const std::vector<Station>& stations) {
+	if (from == to)
+		return from;
+	const RouteEntry& route = table.at(from, to);
+	const int* policy = peak ? route.policy : route.policy_offpeak;
+	for (int i = 1; i < route.policy_num && i < MAX_POLICY_NUM; i++) {
+		if (policy[i] >= 0 && policy[i] < int(stations.size()) && stations[policy[i]].lineID == lineID)
+			return policy[i];
+	}
+	return policy[0];
+}
+
+// the same as getRealStation(), with the direction to take there. realStation is -1 if there is no path
+static TransferClosure realStationOf(const RouteTable& table, bool peak, int from, int to, \
+	const std::vector<Station>& stations) {
+	const TransferClosure& closure = table.closure(from, to, peak);
+	if (closure.realStation >= 0)
+		return closure;
+
+	// a random choice on the way, walk with the first policies
+	TransferClosure result = { -1, -1, 0.0 };
+	int N = table.size();
+	int station = from;
+	for (int steps = 0; steps < N; steps++) {
+		int next = nextStationOf(table, peak, station, to, -1, stations);
+		if (next < 0 || next >= N)
+			return result;
+		const RouteEntry& entry = table.at(station, next);
+		if (entry.transferTime == -1) {
+			result.realStation = station;
+			result.direction = (station == to) ? -1 : entry.direction;
+			return result;
+		}
+		result.transferTime += entry.transferTime;
+		station = next;
+	}
+	result.transferTime = 0.0;
+	return result;
+}
+
+static void addTo(std::vector<FluidSplit>& splits, int target, double walkTime, double num) {
+	for (auto iter = splits.begin(); iter != splits.end(); iter++) {
+		if (iter->queue == target && iter->walkTime == walkTime) {
+			iter->fraction += num;
+			return;
+		}
+	}
+	FluidSplit split = { target, walkTime, num };
+	splits.push_back(split);
+}
+
+void FluidFlows::addSplit(int q, int target, double walkTime, double num) {
+	alighting[q] += num;
+	addTo(splits[q], target, walkTime, num);
+}
+
+void FluidFlows::addEnd(int q, int target, double walkTime, double num) {
+	ending[q] += num;
+	addTo(ends[q], target, walkTime, num);
+}
+
+void FluidFlows::add(const FluidFlows& other) {
+	for (size_t q = 0; q < onboard.size(); q++) {
+		onboard[q] += other.onboard[q];
+		alighting[q] += other.alighting[q];
+		ending[q] += other.ending[q];
+		for (auto iter = other.splits[q].cbegin(); iter != other.splits[q].cend(); iter++)
+			addTo(splits[q], iter->queue, iter->walkTime, iter->fraction);
+		for (auto iter = other.ends[q].cbegin(); iter != other.ends[q].cend(); iter++)
+			addTo(ends[q], iter->queue, iter->walkTime, iter->fraction);
+	}
+}
+
+// Trace each group of the fixed OD through the routes of the slice it comes in, leg by leg as
+// run() would move it: on the train from the real station along the next stops, off at the
+// destination or where the policy says to transfer, then on from the station it walks to.
+// With 'recorded' (by fitFluid()) the flows of the slices are taken instead.
+// A queue no passenger of a set gets off at takes the flows of all the sets
+void Simulation::buildFluidModel(const std::vector<FluidFlows>* recorded) {
+	std::shared_ptr<FluidModel> model = std::make_shared<FluidModel>();
+	model->routes = routes.get();
+	model->closedLinks = closedLinks;
+	model->closedStations = closedStations;
+	model->fitted = (recorded != NULL);
+	int numQueues = numStations * 2;
+
+	// the next stops of the loaded timetable, the first edit of a trip keeps it as it was loaded
+	std::vector<const std::vector<int>*> loadedStops(totalTrainNum, (const std::vector<int>*)NULL);
+	for (auto iter = incidentEdits.crbegin(); iter != incidentEdits.crend(); iter++)
+		loadedStops[startTrainInfo[iter->row][0]] = &iter->arrivalStationID;
+	model->nextStop.assign(numQueues, -1);
+	for (int row = 0; row < totalTrainNum; row++) {
+		int trainID = startTrainInfo[row][0];
+		int direction = startTrainInfo[row][3];
+		int last = startTrainInfo[row][1];
+		const std::vector<int>& stops = loadedStops[trainID] ? *loadedStops[trainID] : arrivalStationID[trainID];
+		for (auto iter = stops.cbegin(); iter != stops.cend(); iter++) {
+			if (last < 0 || last >= numStations || *iter < 0 || *iter >= numStations || direction < 0 || direction > 1)
+				break;
+			if (model->nextStop[last * 2 + direction] < 0)
+				model->nextStop[last * 2 + direction] = *iter;
+			last = *iter;
+		}
+	}
+
+	// the policy sets of the slices, and the set index of each slice
+	std::vector<int> sliceSet(routingIndex->numSlices());
+	for (int i = 0; i < routingIndex->numSlices(); i++) {
+		int set = routingIndex->slice(i).policySet;
+		auto found = std::find(model->sets.begin(), model->sets.end(), set);
+		sliceSet[i] = int(found - model->sets.begin());
+		if (found == model->sets.end())
+			model->sets.push_back(set);
+	}
+	int numSets = int(model->sets.size());
+
+	std::vector<FluidFlows> flows(numSets, FluidFlows(numQueues));
+	if (recorded) {
+		for (size_t i = 0; i < recorded->size() && i < sliceSet.size(); i++)
+			flows[sliceSet[i]].add((*recorded)[i]);
+	}
+	else {
+		for (auto iter_row = fixedOD.cbegin(); iter_row != fixedOD.cend(); iter_row++) {
+			int O = (*iter_row)[0];
+			int D = (*iter_row)[1];
+			double num = (*iter_row)[2];
+			double odTime = ((*iter_row)[3] < START_TIME) ? START_TIME : (*iter_row)[3];
+			int s = sliceSet[routingIndex->find(odTime)];
+			bool peak;
+			const RouteTable& table = *policyRoutes(model->sets[s], peak);
+			FluidFlows& flow = flows[s];
+
+			int from = O;
+			for (int leg = 0; leg < numStations && from != D; leg++) {
+				TransferClosure real = realStationOf(table, peak, from, D, stations);
+				if (real.realStation < 0 || real.realStation == D || real.direction < 0)
+					break;
+				int direction = real.direction;
+				int lineID = stations[real.realStation].lineID;
+				int station = model->nextStop[real.realStation * 2 + direction];
+				from = D;		// lost if the train never gets anywhere
+				for (int stop = 0; stop < numStations && station >= 0; stop++) {
+					int q = station * 2 + direction;
+					flow.onboard[q] += num;
+					if (station == D) {
+						flow.addSplit(q, -1, 0.0, num);
+						break;
+					}
+					if (stations[station].isTransfer) {
+						TransferClosure next = realStationOf(table, peak, station, D, stations);
+						if (next.realStation == D) {
+							flow.addSplit(q, -1, next.transferTime, num);
+							break;
+						}
+						int nextStation = nextStationOf(table, peak, station, D, lineID, stations);
+						if (next.realStation >= 0 && next.direction >= 0 && nextStation >= 0 && nextStation < numStations \
+							&& table.at(station, nextStation).transferTime != -1) {
+							flow.addSplit(q, next.realStation * 2 + next.direction, next.transferTime, num);
+							from = next.realStation;
+							break;
+						}
+					}
+					station = model->nextStop[q];
+				}
+			}
+		}
+	}
+
+	// the shares and the splits as the parts of the passengers getting off (or left on)
+	FluidFlows all(numQueues);
+	for (int s = 0; s < numSets; s++)
+		all.add(flows[s]);
+	model->alightShare.assign(numSets, std::vector<double>(numQueues, 0.0));
+	model->splitStart.assign(numSets, std::vector<int>(numQueues + 1, 0));
+	model->splits.assign(numSets, std::vector<FluidSplit>());
+	model->endStart.assign(numSets, std::vector<int>(numQueues + 1, 0));
+	model->endSplits.assign(numSets, std::vector<FluidSplit>());
+	for (int s = 0; s < numSets; s++) {
+		for (int q = 0; q < numQueues; q++) {
+			const FluidFlows& flow = (flows[s].alighting[q] > 0.0) ? flows[s] : all;
+			if (flow.onboard[q] > 0.0)
+				model->alightShare[s][q] = flow.alighting[q] / flow.onboard[q];
+			for (auto iter = flow.splits[q].cbegin(); iter != flow.splits[q].cend(); iter++) {
+				FluidSplit split = { iter->queue, iter->walkTime, iter->fraction / flow.alighting[q] };
+				model->splits[s].push_back(split);
+			}
+			model->splitStart[s][q + 1] = int(model->splits[s].size());
+
+			const FluidFlows& end = (flows[s].ending[q] > 0.0) ? flows[s] : all;
+			for (auto iter = end.ends[q].cbegin(); iter != end.ends[q].cend(); iter++) {
+				FluidSplit split = { iter->queue, iter->walkTime, iter->fraction / end.ending[q] };
+				model->endSplits[s].push_back(split);
+			}
+			model->endStart[s][q + 1] = int(model->endSplits[s].size());
+		}
+	}
+	fluidModel = model;
+}
+
+// Where the passengers getting off at the queue go, recorded in the flows of the slice: the
+// queue they join after walking on from 'from' with the first policies, as the fluid does, or
+// -1 at 'to'. Those without a path are lost, as they get nowhere in run()
+void Simulation::recordFluid(int queue, int from, int to, double walkTime, int num, bool ending) {
+	if (num <= 0)
+		return;
+	FluidFlows& flow = (*fluidRecord)[slice];
+	int target = -1;
+	if (from != to) {
+		TransferClosure real = realStationOf(*sliceRoutes, slicePeak, from, to, stations);
+		if (real.realStation < 0 || (real.realStation != to && real.direction < 0)) {
+			(ending ? flow.ending : flow.alighting)[queue] += num;
+			return;
+		}
+		walkTime += real.transferTime;
+		if (real.realStation != to)
+			target = real.realStation * 2 + real.direction;
+	}
+	if (ending)
+		flow.addEnd(queue, target, walkTime, num);
+	else
+		flow.addSplit(queue, target, walkTime, num);
+}
+
+// Run a copy to the end of the day recording where the passengers get off and go, and make the
+// model from that instead of the fixed OD: the trains are as full as they really are, and the
+// passengers left on at the end of a trip go where run() sends them
+void Simulation::fitFluid() {
+	if (!routingIndex)
+		throw "The simulator must be initialized before fitFluid()!";
+	std::vector<FluidFlows> recorded(routingIndex->numSlices(), FluidFlows(numStations * 2));
+	Simulation day;
+	day.init(*this);
+	day.cloneState(*this);
+	day.fluidRecord = &recorded;
+	Report report;
+	do {
+		report = day.run();
+	} while (!report.isFinished && day.hasEvents());
+	buildFluidModel(&recorded);
+}
+
+// Go on from the current state to the end of the day with the flows, as described in Fluid.hpp.
+// The passengers in the queues and on the trains are taken as they are, the ODs and arrivals in
+// the event queue are used as run() would, the suspend points are passed. The random choices
+// on the way take the first policy. Nothing of the simulator is changed but the model kept for
+// the next call
+Report Simulation::runFluid(double dt) {
+	if (!(dt > 0.0))
+		throw "The step of runFluid() must be positive!";
+	if (!routingIndex)
+		throw "The simulator must be initialized before runFluid()!";
+	if (!fluidModel || fluidModel->routes != routes.get() || fluidModel->closedLinks != closedLinks || \
+		fluidModel->closedStations != closedStations)
+		buildFluidModel();
+	FluidModel& model = *fluidModel;
+	int numQueues = numStations * 2;
+
+	double start = time;
+	int numSteps = (start < SIMULATION_END_TIME) ? int(ceil((SIMULATION_END_TIME - start) / dt)) : 0;
+	auto stepOf = [start, dt](double t) {
+		return (t <= start) ? 0 : int((t - start) / dt);
+	};
+
+	// the table and the set index of each slice
+	std::vector<const RouteTable*> sliceTable(routingIndex->numSlices());
+	std::vector<char> slicePeaks(routingIndex->numSlices());
+	std::vector<int> sliceSet(routingIndex->numSlices());
+	for (int i = 0; i < routingIndex->numSlices(); i++) {
+		int set = routingIndex->slice(i).policySet;
+		bool peak;
+		sliceTable[i] = policyRoutes(set, peak);
+		slicePeaks[i] = peak;
+		sliceSet[i] = int(std::find(model.sets.begin(), model.sets.end(), set) - model.sets.begin());
+	}
+
+	double travelTime = totalTravelTime;
+	double delay = totalDelay;
+	double departed = num_departed;
+	double arrived = num_arrived;
+
+	// the queues, counted as run() does: the waiting since the average start is added when a train comes
+	std::vector<double> waiting(numQueues);
+	std::vector<double> since(numQueues);
+	for (int i = 0; i < numStations; i++) {
+		for (int direction = 0; direction < 2; direction++) {
+			waiting[i * 2 + direction] = stations[i].queueSize[direction];
+			since[i * 2 + direction] = stations[i].avg_inStationTime[direction];
+		}
+	}
+	auto join = [&waiting, &since, &departed](int q, double num, double t, bool departing) {
+		if (num <= 0.0)
+			return;
+		double total = waiting[q] + num;
+		since[q] = (waiting[q] * since[q] + num * t) / total;
+		waiting[q] = total;
+		if (departing)
+			departed += num;
+	};
+
+	// the ODs and the trains of the event queue, each into the step it comes in
+	std::vector<std::vector<FluidInflow>>& inflows = model.inflows;
+	std::vector<std::vector<int>>& arriving = model.arriving;
+	std::vector<FluidTrain>& fluidTrains = model.trains;
+	if (int(inflows.size()) < numSteps + 1) {
+		inflows.resize(numSteps + 1);
+		arriving.resize(numSteps + 1);
+	}
+	for (int k = 0; k <= numSteps; k++) {
+		inflows[k].clear();
+		arriving[k].clear();
+	}
+	fluidTrains.clear();
+	EventQueue->forEach([&](Event& event) {
+		if (event.type == ARRIVAL) {
+			Train* train = event.train;
+			if (event.time >= SIMULATION_END_TIME)
+				return;
+			FluidTrain fluidTrain = { train->trainID, train->direction, train->arrivingStation, time_iter[train->trainID], \
+				event.time, train->lastTime, double(train->passengerNum), double(train->capacity + train->passengerNum) };
+			arriving[stepOf(event.time)].push_back(int(fluidTrains.size()));
+			fluidTrains.push_back(fluidTrain);
+		}
+		else if (event.type == NEW_OD && event.from != event.to) {
+			// the cases of run()
+			double t = event.time;
+			int from = event.from;
+			for (int hop = 0; hop < numStations && t < SIMULATION_END_TIME; hop++) {
+				int i = routingIndex->find(t);
+				TransferClosure real = realStationOf(*sliceTable[i], slicePeaks[i] != 0, from, event.to, stations);
+				if (real.realStation < 0)
+					break;
+				if (real.realStation == from && t >= START_TIME) {
+					FluidInflow inflow = { from * 2 + real.direction, double(event.num), t, !event.isTransfer };
+					inflows[stepOf(t)].push_back(inflow);
+					break;
+				}
+				if (real.realStation == event.to) {
+					travelTime += real.transferTime;
+					break;
+				}
+				if (real.realStation != from) {
+					travelTime += real.transferTime;
+					from = real.realStation;
+					t += real.transferTime;
+				}
+				else {
+					t = START_TIME;
+				}
+			}
+		}
+	});
+
+	// the passengers walking to a queue or the trains arriving again in the same step, the earliest
+	// first (the rest of the step is sorted once)
+	std::vector<FluidInflow>& walking = model.walking;
+	std::vector<int>& again = model.again;
+	walking.clear();
+	again.clear();
+	auto inflowLater = [](const FluidInflow& left, const FluidInflow& right) {
+		return left.time > right.time;
+	};
+	auto trainLater = [&fluidTrains](int left, int right) {
+		return fluidTrains[left].time > fluidTrains[right].time;
+	};
+
+	// the passengers getting off in step k at time t, arriving or walking to another queue
+	auto getOff = [&](const FluidSplit& split, double num, double t, int k) {
+		travelTime += num * split.walkTime;
+		if (split.queue < 0) {
+			arrived += num;
+			return;
+		}
+		double walked = t + split.walkTime;
+		if (walked >= SIMULATION_END_TIME)
+			return;
+		FluidInflow inflow = { split.queue, num, walked, false };
+		if (stepOf(walked) <= k) {
+			walking.push_back(inflow);
+			std::push_heap(walking.begin(), walking.end(), inflowLater);
+		}
+		else {
+			inflows[stepOf(walked)].push_back(inflow);
+		}
+	};
+
+	// step by step, the trains arriving in the step in order of time: the passengers who have come
+	// by then join the queues, so none gets on a train which has left before
+	for (int k = 0; k < numSteps; k++) {
+		int s = sliceSet[routingIndex->find(start + k * dt)];
+		const double* alightShare = model.alightShare[s].data();
+		const int* splitStart = model.splitStart[s].data();
+		const FluidSplit* splits = model.splits[s].data();
+		const int* endStart = model.endStart[s].data();
+		const FluidSplit* endSplits = model.endSplits[s].data();
+		std::vector<FluidInflow>& joining = inflows[k];
+		std::vector<int>& due = arriving[k];
+		std::sort(joining.begin(), joining.end(), [](const FluidInflow& left, const FluidInflow& right) {
+			return left.time < right.time;
+		});
+		std::sort(due.begin(), due.end(), [&fluidTrains](int left, int right) {
+			return fluidTrains[left].time < fluidTrains[right].time;
+		});
+		size_t nextJoining = 0;
+		size_t nextDue = 0;
+
+		while (nextDue < due.size() || !again.empty()) {
+			int index;
+			if (again.empty() || (nextDue < due.size() && !trainLater(due[nextDue], again.front()))) {
+				index = due[nextDue++];
+			}
+			else {
+				std::pop_heap(again.begin(), again.end(), trainLater);
+				index = again.back();
+				again.pop_back();
+			}
+			FluidTrain& train = fluidTrains[index];
+			double t = train.time;
+			for (; nextJoining < joining.size() && joining[nextJoining].time <= t; nextJoining++)
+				join(joining[nextJoining].queue, joining[nextJoining].num, joining[nextJoining].time, joining[nextJoining].departing);
+			while (!walking.empty() && walking.front().time <= t) {
+				std::pop_heap(walking.begin(), walking.end(), inflowLater);
+				join(walking.back().queue, walking.back().num, walking.back().time, false);
+				walking.pop_back();
+			}
+
+			int q = train.station * 2 + train.direction;
+			travelTime += train.load * (t - train.lastTime);
+
+			// a part of the load gets off, arrives or walks to another queue
+			double off = train.load * alightShare[q];
+			train.load -= off;
+			for (int i = splitStart[q]; i < splitStart[q + 1]; i++)
+				getOff(splits[i], off * splits[i].fraction, t, k);
+
+			// the rest at the end of the trip go where run() sends them in the fitted day,
+			// or wait for the next train there
+			if (train.next >= int(arrivalTime[train.trainID].size())) {
+				for (int i = endStart[q]; i < endStart[q + 1]; i++)
+					getOff(endSplits[i], train.load * endSplits[i].fraction, t, k);
+				if (endStart[q] == endStart[q + 1])
+					join(q, train.load, t, false);
+				train.load = 0.0;
+				continue;
+			}
+
+			// the queue gets on as far as there is space
+			double wait = (t - since[q]) * waiting[q];
+			delay += wait;
+			travelTime += wait;
+			since[q] = t;
+			double space = train.capacity - train.load;
+			double board = (waiting[q] < space) ? waiting[q] : space;
+			if (board > 0.0) {
+				waiting[q] -= board;
+				train.load += board;
+			}
+			train.lastTime = t;
+
+			train.time = arrivalTime[train.trainID][train.next];
+			train.station = arrivalStationID[train.trainID][train.next];
+			train.next++;
+			if (train.time >= SIMULATION_END_TIME)
+				continue;
+			if (stepOf(train.time) > k) {
+				arriving[stepOf(train.time)].push_back(index);
+			}
+			else {
+				again.push_back(index);
+				std::push_heap(again.begin(), again.end(), trainLater);
+			}
+		}
+
+		// the rest of the step wait for the next steps
+		for (; nextJoining < joining.size(); nextJoining++)
+			join(joining[nextJoining].queue, joining[nextJoining].num, joining[nextJoining].time, joining[nextJoining].departing);
+		for (auto iter = walking.cbegin(); iter != walking.cend(); iter++)
+			join(iter->queue, iter->num, iter->time, false);
+		walking.clear();
+	}
+
+	Report result;
+	result.isFinished = true;
+	result.totalTravelTime = travelTime;
+	result.totalDelay = delay;
+	result.numDeparted = int(departed + 0.5);
+	result.numArrived = int(arrived + 0.5);
+	result.stats = NULL;
+	return result;
+}
+
+typedef std::chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start) {
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static double relativeError(double fluid, double des) {
+	return (des != 0.0) ? (fluid - des) / des : 0.0;
+}
+
+FluidErrors::FluidErrors(const Report& fluid, const Report& des) {
+	travelTime = relativeError(fluid.totalTravelTime, des.totalTravelTime);
+	delay = relativeError(fluid.totalDelay, des.totalDelay);
+	departed = relativeError(fluid.numDeparted, des.numDeparted);
+	arrived = relativeError(fluid.numArrived, des.numArrived);
+}
+
+// the short turn of the check, the number of trips changed
+static int injectCheckIncident(Simulation& sim) {
+	int lineID = sim.stations[0].lineID;
+	for (int i = 1; i < sim.numStations; i++) {
+		if (sim.stations[i].lineID == lineID)
+			return sim.injectIncident(lineID, 0, i, 40000.0, 50000.0, INCIDENT_SHORT_TURN);
+	}
+	return 0;
+}
+
+// the busier day of the check: a fifth of the groups of the fixed OD (picked by a fixed seed)
+// come again half an hour later
+#define HELD_OUT_SEED 20250
+static void addHeldOutDemand(Simulation& sim) {
+	CounterRNG rng(HELD_OUT_SEED);
+	std::vector<double> t;
+	std::vector<int> from, to, num;
+	for (auto iter_row = sim.fixedOD.cbegin(); iter_row != sim.fixedOD.cend(); iter_row++) {
+		if (rng() % 5 != 0)
+			continue;
+		double time = (*iter_row)[3] + 1800.0;
+		if (time >= SIMULATION_END_TIME)
+			continue;
+		t.push_back(time);
+		from.push_back((*iter_row)[0]);
+		to.push_back((*iter_row)[1]);
+		num.push_back((*iter_row)[2]);
+	}
+	sim.addODBatch(t.data(), from.data(), to.data(), num.data(), t.size());
+}
+
+FluidCalibration calibrateFluid(const Simulation& loaded, double dt) {
+	FluidCalibration result;
+	result.dt = dt;
+	Simulation sim;
+	sim.init(loaded);
+
+	sim.reset();
+	Clock::time_point start = Clock::now();
+	sim.fitFluid();
+	result.modelSeconds = secondsSince(start);
+
+	// the model is only measured on days it was not fitted on, the extra demand and the
+	// incident leave the routes as they are
+	sim.reset();
+	addHeldOutDemand(sim);
+	sim.runFluid(dt);		// the first call allocates the steps
+	start = Clock::now();
+	result.fluid = sim.runFluid(dt);
+	result.fluidSeconds = secondsSince(start);
+	start = Clock::now();
+	result.des = sim.run();
+	result.desSeconds = secondsSince(start);
+	result.des.stats = NULL;
+	result.errors = FluidErrors(result.fluid, result.des);
+
+	sim.reset();
+	result.perturbed = injectCheckIncident(sim) > 0;
+	if (result.perturbed) {
+		Report fluid = sim.runFluid(dt);
+		Report des = sim.run();
+		result.perturbedErrors = FluidErrors(fluid, des);
+	}
+	return result;
+}
+
+void FluidCalibration::show() {
+	cout << "fluid step (sec):\t\t" << dt << "\n";
+	cout << "errors, not on the fitted day (busier day / short turn):\n";
+	cout << "totalTravelTime error:\t\t" << errors.travelTime * 100.0 << "% / " << perturbedErrors.travelTime * 100.0 << "%\n";
+	cout << "totalDelay error:\t\t" << errors.delay * 100.0 << "% / " << perturbedErrors.delay * 100.0 << "%\n";
+	cout << "# passenger departed error:\t" << errors.departed * 100.0 << "% / " << perturbedErrors.departed * 100.0 << "%\n";
+	cout << "# passenger arrived error:\t" << errors.arrived * 100.0 << "% / " << perturbedErrors.arrived * 100.0 << "%\n";
+	if (!perturbed)
+		cout << "(no trip on the line of station 0 to short turn)\n";
+	cout << "run() / runFluid() (ms):\t" << desSeconds * 1000.0 << " / " << fluidSeconds * 1000.0 \
+		<< " (" << desSeconds / fluidSeconds << "x, fitting the model " << modelSeconds * 1000.0 << " ms once)\n";
+}
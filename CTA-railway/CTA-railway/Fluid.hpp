@@ -0,0 +1,121 @@
+#pragma once
+#include "Simulation.hpp"
+
+// The fluid approximation of Simulation::runFluid(), to screen many incidents/controls quickly.
+// The passengers are amounts instead of groups: each queue (station * 2 + direction) is one
+// amount and each train one load, without their destinations. The day goes on in steps of dt
+// sec with the same timetable, capacities and routes: the trains arriving in a step, in order
+// of time, let a part of their load get off, then take what fits from the queue, after the
+// amounts added until then have joined it. The part getting off at each queue, and where they go (the
+// destination or another queue after the transfer), is the average of the fixed OD traced
+// through the routes of each policy set, or of a day of run() recorded by fitFluid(), see
+// FluidModel. The delays and travel times are counted as run() does, so the report has the
+// same fields. calibrateFluid() tells how far it is from run() on the loaded data.
+// The traced shares take every passenger of the OD on the first train, as if the trains were
+// never full, and know nothing of the passengers left on at the end of a trip, so on a busy day
+// they are about 6% short in the delay. Fitted from run() (for each slice) on one day, the totals
+// of the days it was not fitted on (a fifth more demand, or a short turn) are within 1% of run()
+// for steps of 10 to 300 sec.
+// The speedup is single-digit: a day of runFluid() is only about 3-7x faster than run() (5-7x on
+// the rail data, 5-6x on the 8x8 grid), and fitFluid() costs a day of run() once for the routes.
+// The trains are swept one arrival after another, each reading and writing the queues it stops
+// at, so the loops gather and scatter and are not vectorised: the speed comes from the amounts
+// (one number per queue instead of the groups of each destination) alone.
+#define FLUID_DEFAULT_DT 60.0	// sec
+
+// a train of runFluid(), the load without the destinations
+struct FluidTrain {
+	int trainID;
+	int direction;
+	int station;		// where it arrives next
+	int next;			// the index of the arrival after that in the timetable
+	double time;		// when it arrives
+	double lastTime;
+	double load;
+	double capacity;	// the whole train, not the space left
+};
+
+// the passengers joining a queue in a step
+struct FluidInflow {
+	int queue;
+	double num;
+	double time;
+	bool departing;		// counted in num_departed, not a transfer
+};
+
+// where a part of the passengers getting off at a queue go
+struct FluidSplit {
+	int queue;			// the queue they walk to, -1 if they have arrived
+	double walkTime;	// the transfer time
+	double fraction;	// of the passengers getting off
+};
+
+// the passengers of a policy set getting on and off at each queue, traced from the fixed OD by
+// buildFluidModel() or recorded from run() (for each slice) by fitFluid()
+struct FluidFlows {
+	std::vector<double> onboard;	// [queue] arriving on the trains
+	std::vector<double> alighting;	// [queue] getting off
+	std::vector<std::vector<FluidSplit>> splits;	// [queue] where they go, 'fraction' is the number
+	std::vector<double> ending;		// [queue] left on at the end of a trip (recorded only)
+	std::vector<std::vector<FluidSplit>> ends;		// [queue] where they go, 'fraction' is the number
+
+	FluidFlows(int numQueues) : onboard(numQueues, 0.0), alighting(numQueues, 0.0), splits(numQueues), \
+		ending(numQueues, 0.0), ends(numQueues) {}
+	void addSplit(int q, int target, double walkTime, double num);
+	void addEnd(int q, int target, double walkTime, double num);
+	void add(const FluidFlows& other);
+};
+
+// the fixed OD aggregated for each policy set, made from the routes and the timetable of a
+// simulator (again when its routes change)
+struct FluidModel {
+	const RouteTable* routes;		// what it's made from
+	std::vector<std::pair<int, int>> closedLinks;
+	std::vector<int> closedStations;
+	bool fitted;					// recorded from run() by fitFluid(), not traced
+
+	std::vector<int> nextStop;		// [queue] the next station of the trains, -1 after the terminal
+	std::vector<int> sets;			// the policy sets of the slices, in order of their first slice
+	std::vector<std::vector<double>> alightShare;	// [set index][queue] the part of the load getting off
+	std::vector<std::vector<int>> splitStart;		// [set index][queue] where the splits of the queue start,
+	std::vector<std::vector<FluidSplit>> splits;	// one more at the end
+	std::vector<std::vector<int>> endStart;			// the same for the load left at the end of a trip,
+	std::vector<std::vector<FluidSplit>> endSplits;	// none if they wait for the next train there
+
+	// the steps of the last call, kept so that the next one allocates nothing
+	std::vector<std::vector<FluidInflow>> inflows;	// [step]
+	std::vector<std::vector<int>> arriving;			// [step] the trains arriving in the step
+	std::vector<FluidTrain> trains;
+	std::vector<FluidInflow> walking;				// in the step, see runFluid()
+	std::vector<int> again;
+};
+
+// the relative errors (fluid - des) / des of a day
+struct FluidErrors {
+	double travelTime;
+	double delay;
+	double departed;
+	double arrived;
+	FluidErrors(const Report& fluid, const Report& des);
+	FluidErrors() : travelTime(0.0), delay(0.0), departed(0.0), arrived(0.0) {}
+};
+
+// how far runFluid(dt) is from run(), with the model fitted on a day from reset() on the same
+// data, measured only on days it was not fitted on: a busier day (a fifth of the fixed OD again,
+// half an hour later) and the day with a short turn (the line of station 0 from 40000 to 50000
+// sec, as the self-test)
+struct FluidCalibration {
+	double dt;
+	Report des;						// run() of the busier day
+	Report fluid;					// runFluid(dt) of the busier day
+	FluidErrors errors;				// on the busier day
+	bool perturbed;					// if the short turn changed a trip
+	FluidErrors perturbedErrors;
+	double desSeconds;				// the time of the busier day of run()
+	double fluidSeconds;			// the time of a day of runFluid(), the model made already
+	double modelSeconds;			// the time of fitFluid(), once for the routes
+	void show();
+};
+
+// fit runFluid(dt) on a simulator sharing the data of 'loaded' and measure it against run()
+FluidCalibration calibrateFluid(const Simulation& loaded, double dt);
@@ -0,0 +1,273 @@
+//Header Files
+#include "util.hpp"
+#include "Simulation.hpp"
+#include "Generator.hpp"
+#include "RouteBuilder.hpp"
+#include <stdio.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+NetworkSpec::NetworkSpec() : layout(GRID_NETWORK), numLines(8), stationsBetween(4), runTime(90.0), headway(300.0), \
+	firstTrain(14400.0), lastTrain(SIMULATION_END_TIME), transferTime(30.0), capacity(DEFAULT_CAPACITY), numODs(60000), \
+	maxGroup(20), demandStart(START_TIME), demandEnd(SIMULATION_END_TIME), seed(0), writeCache(true) {}
+
+bool NetworkSpec::set(const std::string& name, const std::string& value) {
+	double number = atof(value.c_str());
+	if (name == "layout") {
+		if (value == "grid")
+			layout = GRID_NETWORK;
+		else if (value == "radial")
+			layout = RADIAL_NETWORK;
+		else
+			return false;
+	}
+	else if (name == "numLines")
+		numLines = int(number);
+	else if (name == "stationsBetween")
+		stationsBetween = int(number);
+	else if (name == "runTime")
+		runTime = number;
+	else if (name == "headway")
+		headway = number;
+	else if (name == "firstTrain")
+		firstTrain = number;
+	else if (name == "lastTrain")
+		lastTrain = number;
+	else if (name == "transferTime")
+		transferTime = number;
+	else if (name == "capacity")
+		capacity = int(number);
+	else if (name == "numODs")
+		numODs = int(number);
+	else if (name == "maxGroup")
+		maxGroup = int(number);
+	else if (name == "demandStart")
+		demandStart = number;
+	else if (name == "demandEnd")
+		demandEnd = number;
+	else if (name == "seed")
+		seed = (unsigned int)strtoul(value.c_str(), NULL, 10);
+	else if (name == "writeCache")
+		writeCache = (value == "true" || value == "1");
+	else
+		return false;
+	return true;
+}
+
+// the lines as the places they stop at, a place crossed by several lines is a transfer station
+static int buildLines(const NetworkSpec& spec, std::vector<std::vector<int>>& lines) {
+	int numPlaces = 0;
+	if (spec.layout == GRID_NETWORK) {
+		// place (x, y) of the grid, only the places on a line are used
+		int step = spec.stationsBetween + 1;
+		int length = (spec.numLines - 1) * step + 1;
+		std::vector<int> placeAt(size_t(length) * length, -1);
+		auto place = [&placeAt, &numPlaces, length](int x, int y) {
+			int& id = placeAt[size_t(y) * length + x];
+			if (id < 0)
+				id = numPlaces++;
+			return id;
+		};
+		for (int h = 0; h < spec.numLines; h++) {
+			std::vector<int> line;
+			for (int x = 0; x < length; x++)
+				line.push_back(place(x, h * step));
+			lines.push_back(line);
+		}
+		for (int v = 0; v < spec.numLines; v++) {
+			std::vector<int> line;
+			for (int y = 0; y < length; y++)
+				line.push_back(place(v * step, y));
+			lines.push_back(line);
+		}
+	}
+	else {
+		// place 0 is the center
+		numPlaces = 1;
+		for (int l = 0; l < spec.numLines; l++) {
+			std::vector<int> line(spec.stationsBetween * 2 + 1);
+			line[spec.stationsBetween] = 0;
+			for (int i = 1; i <= spec.stationsBetween; i++) {
+				line[spec.stationsBetween - i] = numPlaces++;
+				line[spec.stationsBetween + i] = numPlaces++;
+			}
+			lines.push_back(line);
+		}
+	}
+	return numPlaces;
+}
+
+static bool makeDirectory(const std::string& dir) {
+	struct stat st;
+	if (stat(dir.c_str(), &st) == 0)
+		return true;
+#ifdef _WIN32
+	return _mkdir(dir.c_str()) == 0;
+#else
+	return mkdir(dir.c_str(), 0755) == 0;
+#endif
+}
+
+int generateNetwork(const NetworkSpec& spec, const std::string& outDir) {
+	if (spec.numLines < (spec.layout == GRID_NETWORK ? 2 : 1) || spec.stationsBetween < (spec.layout == GRID_NETWORK ? 0 : 1) || \
+		spec.runTime <= 0 || spec.headway <= 0 || spec.maxGroup < 1) {
+		cout << "illegal network parameters!\n";
+		return -1;
+	}
+	if (!makeDirectory(outDir)) {
+		cout << "can't create " << outDir << "\n";
+		return -1;
+	}
+	string dir = outDir + "/";
+
+	// a station ID for each stop of each line, in the order of the lines
+	std::vector<std::vector<int>> lines;
+	int numPlaces = buildLines(spec, lines);
+	std::vector<std::vector<int>> placeStations(numPlaces);
+	std::vector<int> stationPlace;
+	std::vector<std::vector<int>> lineStations;
+	for (auto iter_line = lines.cbegin(); iter_line != lines.cend(); iter_line++) {
+		std::vector<int> stops;
+		for (auto iter = iter_line->cbegin(); iter != iter_line->cend(); iter++) {
+			int station = int(stationPlace.size());
+			stationPlace.push_back(*iter);
+			placeStations[*iter].push_back(station);
+			stops.push_back(station);
+		}
+		lineStations.push_back(stops);
+	}
+	int N = int(stationPlace.size());
+	cout << "Generating " << lines.size() << " lines, " << N << " stations...";
+
+	bool ok = true;
+	FILE* file;
+
+	// stations: [stationID, lineID, isTerminal0, isTerminal1, isTransfer], direction 0 goes along the
+	// line to its last station
+	file = fopen((dir + "stations.csv").c_str(), "w");
+	ok = ok && file != NULL;
+	for (int l = 0; ok && l < int(lineStations.size()); l++) {
+		const std::vector<int>& stops = lineStations[l];
+		for (int i = 0; i < int(stops.size()); i++) {
+			bool isTransfer = placeStations[stationPlace[stops[i]]].size() > 1;
+			fprintf(file, "%d,%d,%s,%s,%s\n", stops[i], l + 1, (i + 1 == int(stops.size())) ? "TRUE" : "FALSE", \
+				(i == 0) ? "TRUE" : "FALSE", isTransfer ? "TRUE" : "FALSE");
+		}
+	}
+	if (file != NULL)
+		ok = (fclose(file) == 0) && ok;
+
+	// directions [from, to, direction] of the next stations, and the links the policies are built
+	// from. a transfer costs the walk and half a headway of waiting
+	FILE* links = fopen((dir + "links.csv").c_str(), "w");
+	file = fopen((dir + "directions.csv").c_str(), "w");
+	ok = ok && file != NULL && links != NULL;
+	if (ok)
+		fprintf(links, "from_station_id,to_station_id,time\n");
+	for (auto iter = lineStations.cbegin(); ok && iter != lineStations.cend(); iter++) {
+		for (size_t i = 0; i + 1 < iter->size(); i++) {
+			int a = (*iter)[i], b = (*iter)[i + 1];
+			fprintf(file, "%d,%d,0\n%d,%d,1\n", a, b, b, a);
+			fprintf(links, "%d,%d,%g\n%d,%d,%g\n", a, b, spec.runTime, b, a, spec.runTime);
+		}
+	}
+	for (auto iter = placeStations.cbegin(); ok && iter != placeStations.cend(); iter++) {
+		for (size_t i = 0; i < iter->size(); i++) {
+			for (size_t j = 0; j < iter->size(); j++) {
+				if (i != j)
+					fprintf(links, "%d,%d,%g\n", (*iter)[i], (*iter)[j], spec.transferTime + spec.headway / 2.0);
+			}
+		}
+	}
+	if (file != NULL)
+		ok = (fclose(file) == 0) && ok;
+	if (links != NULL)
+		ok = (fclose(links) == 0) && ok;
+
+	// transferTime: the full matrix, -1 if the two stations are not at the same place
+	file = fopen((dir + "transferTime.csv").c_str(), "w");
+	ok = ok && file != NULL;
+	std::vector<double> row(N, -1.0);
+	for (int from = 0; ok && from < N; from++) {
+		const std::vector<int>& others = placeStations[stationPlace[from]];
+		for (auto iter = others.cbegin(); iter != others.cend(); iter++)
+			row[*iter] = (*iter == from) ? -1.0 : spec.transferTime;
+		for (int to = 0; to < N; to++)
+			fprintf(file, (to + 1 < N) ? "%g," : "%g\n", row[to]);
+		for (auto iter = others.cbegin(); iter != others.cend(); iter++)
+			row[*iter] = -1.0;
+	}
+	if (file != NULL)
+		ok = (fclose(file) == 0) && ok;
+
+	// the trains of both directions of each line from the terminals, trainID = the row
+	FILE* info = fopen((dir + "startTrainInfo.csv").c_str(), "w");
+	FILE* times = fopen((dir + "arrivalTime.csv").c_str(), "w");
+	FILE* stops = fopen((dir + "arrivalStationID.csv").c_str(), "w");
+	ok = ok && info != NULL && times != NULL && stops != NULL;
+	int numTrains = 0;
+	for (int l = 0; ok && l < int(lineStations.size()); l++) {
+		for (int direction = 0; direction < 2; direction++) {
+			std::vector<int> trip = lineStations[l];
+			if (direction == 1)
+				std::reverse(trip.begin(), trip.end());
+			for (double start = spec.firstTrain; start <= spec.lastTrain; start += spec.headway) {
+				int startTime = int(start + 0.5);
+				fprintf(info, "%d,%d,%d,%d,%d,%d\n", numTrains++, trip[0], l + 1, direction, spec.capacity, startTime);
+				for (size_t i = 1; i < trip.size(); i++) {
+					const char* end = (i + 1 < trip.size()) ? "," : "\n";
+					fprintf(times, "%g%s", startTime + i * spec.runTime, end);
+					fprintf(stops, "%d%s", trip[i], end);
+				}
+			}
+		}
+	}
+	FILE* files[3] = { info, times, stops };
+	for (int i = 0; i < 3; i++) {
+		if (files[i] != NULL)
+			ok = (fclose(files[i]) == 0) && ok;
+	}
+
+	// fixedOD: [from, to, num, time] in the order of time, not between the stations of the same place
+	CounterRNG rng(spec.seed);
+	std::vector<std::vector<int>> allOD;
+	for (int i = 0; ok && i < spec.numODs && numPlaces > 1; i++) {
+		int from, to;
+		do {
+			from = int(rng() % N);
+			to = int(rng() % N);
+		} while (stationPlace[from] == stationPlace[to]);
+		int num = 1 + int(rng() % spec.maxGroup);
+		int time = int(spec.demandStart + (spec.demandEnd - spec.demandStart) * (rng() / 4294967296.0));
+		std::vector<int> od = { from, to, num, time };
+		allOD.push_back(od);
+	}
+	std::stable_sort(allOD.begin(), allOD.end(), [](const std::vector<int>& left, const std::vector<int>& right) {
+		return left[3] < right[3];
+	});
+	file = fopen((dir + "fixedOD.csv").c_str(), "w");
+	ok = ok && file != NULL;
+	for (auto iter = allOD.cbegin(); ok && iter != allOD.cend(); iter++)
+		fprintf(file, "%d,%d,%d,%d\n", (*iter)[0], (*iter)[1], (*iter)[2], (*iter)[3]);
+	if (file != NULL)
+		ok = (fclose(file) == 0) && ok;
+
+	if (!ok) {
+		cout << "can't write the data into " << outDir << "\n";
+		return -1;
+	}
+	cout << numTrains << " trains, " << allOD.size() << " OD...done\n";
+
+	// the same policies peak and off-peak
+	if (!buildRoutes(dir + "links.csv", "", outDir))
+		return -1;
+
+	// the loader writes the binary image after reading the csv files
+	if (spec.writeCache) {
+		Simulation sim;
+		sim.init(outDir);
+	}
+	return N;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <string>
+
+// Generate a synthetic data set in the format read by Simulation::init(), to see how the engine
+// scales with the number of stations, trains and passengers. The network is one of:
+//	GRID_NETWORK	'numLines' horizontal and 'numLines' vertical lines, each two crossing lines
+//					meet at a transfer station, with 'stationsBetween' stations between two crossings
+//	RADIAL_NETWORK	'numLines' lines through the center (a transfer station of all the lines), each
+//					with 'stationsBetween' stations on both sides of the center
+// Each line is a station ID for each of its stops, like the rail data, the stations of the same
+// place on different lines are connected by the transfer time. The trains run both ways with
+// the same headway all day, the OD are random (same seed, same data).
+enum NetworkLayout {
+	GRID_NETWORK,
+	RADIAL_NETWORK
+};
+
+struct NetworkSpec {
+	NetworkLayout layout;
+	int numLines;			// the lines of each direction (grid), or the lines through the center (radial)
+	int stationsBetween;	// the stations between two crossings (grid), or on each arm (radial)
+	double runTime;			// sec from a station to the next, including the dwell
+	double headway;			// sec between two trains of the same line and direction
+	double firstTrain;		// the first and last departures from the terminals
+	double lastTrain;
+	double transferTime;	// sec to walk between the lines at a transfer station
+	int capacity;			// of each train
+	int numODs;				// the rows of fixedOD.csv
+	int maxGroup;			// the passengers of each row, 1..maxGroup
+	double demandStart;		// the OD happen in [demandStart, demandEnd)
+	double demandEnd;
+	unsigned int seed;
+	bool writeCache;		// also write the binary data cache, by loading the tables once
+
+	NetworkSpec();			// an 8x8 grid, about 2.3x the stations of the rail data
+	bool set(const std::string& name, const std::string& value);	// set by the name of the field, for the command line
+};
+
+// write stations, directions, transferTime, policy, policy2, policy_num, startTrainInfo, arrivalTime,
+// arrivalStationID and fixedOD (and the links the policies are built from, links.csv) into 'outDir'.
+// return the number of stations, or -1 if the files can't be written
+int generateNetwork(const NetworkSpec& spec, const std::string& outDir);
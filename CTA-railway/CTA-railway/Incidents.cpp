@@ -0,0 +1,134 @@
+//Header Files
+#include "util.hpp"
+#include "Simulation.hpp"
+#include "Scheduler.hpp"
+
+// Block the part of a line between two stations (both included, in either order) from 'startTime'
+// to 'endTime'. Each train of the line which would arrive at a blocked station during that time,
+// from its next arrival on, has its trip changed in place:
+//	INCIDENT_DELAY		the train is held so that it arrives there at 'endTime', and the rest of
+//						the trip is delayed as much
+//	INCIDENT_SHORT_TURN	the trip ends at the station before (or at the next arrival, if the train
+//						is already heading into the blocked part), trainEnd() handles the rest
+// The trains which have finished are not changed. The changes are undone by reset(), and
+// snapshots keep the timetable they are taken with, so many incidents can be tried without
+// loading the data again.
+int Simulation::injectIncident(int lineID, int fromStation, int toStation, double startTime, double endTime, \
+	IncidentType type) {
+	if (fromStation < 0 || fromStation >= numStations || toStation < 0 || toStation >= numStations || \
+		stations[fromStation].lineID != lineID || stations[toStation].lineID != lineID || !(startTime < endTime)) {
+		cout << "invalid incident on line " << lineID << " from " << fromStation << " to " << toStation << "\n";
+		throw "Invalid incident!";
+	}
+
+	// the trains with an arrival in the queue, the others have finished
+	std::vector<char> running(totalTrainNum, 0);
+	EventQueue->forEach([&running](Event& event) {
+		if (event.type == ARRIVAL)
+			running[event.train->trainID] = 1;
+	});
+
+	int numChanged = 0;
+	bool reschedule = false;	// if a pending arrival is delayed
+	for (int row = 0; row < totalTrainNum; row++) {
+		std::vector<int>& info = startTrainInfo[row];
+		int trainID = info[0];
+		if (info[2] != lineID || !running[trainID])
+			continue;
+
+		// the positions of the trip: 0 is the starting station, p > 0 is the (p - 1)th arrival in the tables
+		std::vector<double>& times = arrivalTime[trainID];
+		std::vector<int>& stationIDs = arrivalStationID[trainID];
+		int length = int(times.size()) + 1;
+		int pending = time_iter[trainID];	// the position of the arrival in the queue
+		int posFrom = -1, posTo = -1;
+		for (int p = 0; p < length; p++) {
+			int station = (p == 0) ? info[1] : stationIDs[p - 1];
+			if (station == fromStation && posFrom < 0)
+				posFrom = p;
+			if (station == toStation && posTo < 0)
+				posTo = p;
+		}
+		if (posFrom < 0 || posTo < 0)
+			continue;
+
+		// the first arrival in the blocked part during the incident
+		int blocked = -1;
+		for (int p = std::max(std::min(posFrom, posTo), pending); p <= std::max(posFrom, posTo); p++) {
+			double arrival = (p == 0) ? double(info[5]) : times[p - 1];
+			if (arrival >= startTime && arrival < endTime) {
+				blocked = p;
+				break;
+			}
+		}
+		if (blocked < 0)
+			continue;
+
+		incidentEdits.push_back(getTrip(row));
+		numChanged++;
+		if (type == INCIDENT_DELAY) {
+			double delay;
+			if (blocked == 0) {
+				// the start time is in whole seconds
+				int newStart = int(ceil(endTime));
+				delay = double(newStart - info[5]);
+				info[5] = newStart;
+			}
+			else
+				delay = endTime - times[blocked - 1];
+			for (int p = std::max(blocked, 1); p < length; p++)
+				times[p - 1] += delay;
+			if (blocked == pending)
+				reschedule = true;
+		}
+		else {
+			int last = std::max(blocked - 1, pending);
+			times.resize(last);
+			stationIDs.resize(last);
+		}
+	}
+
+	// move the delayed arrivals in the queue, the queue is built again with the new times
+	if (reschedule) {
+		std::vector<Event> events;
+		events.reserve(EventQueue->size());
+		EventQueue->forEach([&events](Event& event) {
+			events.push_back(event);
+		});
+		std::vector<int> rowOf(totalTrainNum);
+		for (int row = 0; row < totalTrainNum; row++)
+			rowOf[startTrainInfo[row][0]] = row;
+		for (auto iter = events.begin(); iter != events.end(); iter++) {
+			if (iter->type != ARRIVAL)
+				continue;
+			int trainID = iter->train->trainID;
+			int pending = time_iter[trainID];
+			iter->time = (pending == 0) ? double(startTrainInfo[rowOf[trainID]][5]) : arrivalTime[trainID][pending - 1];
+		}
+		// by (time, key) as the queue serves them in key order, the keys are unique
+		std::sort(events.begin(), events.end(), eventBefore);
+		EventQueue->clear();
+		EventQueue->pushBatch(events);
+	}
+	return numChanged;
+}
+
+TripEdit Simulation::getTrip(int row) const {
+	int trainID = startTrainInfo[row][0];
+	TripEdit trip = { row, startTrainInfo[row][5], arrivalTime[trainID], arrivalStationID[trainID] };
+	return trip;
+}
+
+void Simulation::setTrip(const TripEdit& trip) {
+	int trainID = startTrainInfo[trip.row][0];
+	startTrainInfo[trip.row][5] = trip.startTime;
+	arrivalTime[trainID] = trip.arrivalTime;
+	arrivalStationID[trainID] = trip.arrivalStationID;
+}
+
+// undo the changes from the last one, so each trip gets the version before its first change
+void Simulation::undoIncidents() {
+	for (auto iter = incidentEdits.rbegin(); iter != incidentEdits.rend(); iter++)
+		setTrip(*iter);
+	incidentEdits.clear();
+}
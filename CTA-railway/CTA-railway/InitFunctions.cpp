@@ -2,187 +2,456 @@
 //Header Files
 #include "util.hpp"
 #include "Simulation.hpp"
+#include "DataCache.hpp"
+#include "Scheduler.hpp"
+#include "RoutingIndex.hpp"
+#include <cstring>
+#include <future>
+#include <new>
+#include <stdint.h>
 
-// this is the function to load the data and initalize the Simulation 
-void Simulation::init() {
-	// first init the variables
-	policy_num = new int* [TOTAL_STATIONS];
-	for (int i = 0; i < TOTAL_STATIONS; i++) {
-		policy_num[i] = new int[TOTAL_STATIONS];
-		for (int j = 0; j < TOTAL_STATIONS; j++) {
-			policy_num[i][j] = 0;
-		}
+// create the table with no path between any two stations
+RouteTable::RouteTable(int numStations, bool compressed) : numStations(numStations), memory(NULL), entries(NULL) {
+	RouteEntry none;
+	for (int k = 0; k < MAX_POLICY_NUM; k++) {
+		none.policy[k] = -1;
+		none.policy_offpeak[k] = -1;
 	}
+	none.policy_num = 0;
+	none.direction = -1;
+	none.transferTime = -1.0;
 
-	policy = new int** [TOTAL_STATIONS];
-	for (int i = 0; i < TOTAL_STATIONS; i++) {
-		policy[i] = new int* [TOTAL_STATIONS];
-		for (int j = 0; j < TOTAL_STATIONS; j++) {
-			policy[i][j] = new int[MAX_POLICY_NUM];
-			for (int k = 0; k < MAX_POLICY_NUM; k++) {
-				policy[i][j][k] = -1;
-			}
-		}
+	if (compressed) {
+		for (int from = 0; from < numStations; from++)
+			compactEntries.appendRow(&none, 1, sameEntry);
+		return;
+	}
+	allocate();
+	size_t num = size_t(numStations) * numStations;
+	for (size_t i = 0; i < num; i++)
+		new (&entries[i]) RouteEntry(none);
+}
+
+RouteTable::RouteTable(const RouteTable& other) : repairs(other.repairs), numStations(other.numStations), memory(NULL), \
+	entries(NULL), closures(other.closures), compactEntries(other.compactEntries) {
+	compactClosures[0] = other.compactClosures[0];
+	compactClosures[1] = other.compactClosures[1];
+	if (other.entries != NULL) {
+		allocate();
+		memcpy((void*)entries, other.entries, other.bytes());
+	}
+}
+
+RouteTable::~RouteTable() {
+	delete[] memory;
+}
+
+void RouteTable::allocate() {
+	memory = new char[bytes() + 64];
+	entries = (RouteEntry*)(((uintptr_t)memory + 63) & ~(uintptr_t)63);
+}
+
+RouteEntry& RouteTable::edit(int from, int to) {
+	if (entries == NULL)
+		setCompressed(false);
+	return entries[size_t(from) * numStations + to];
+}
+
+// a compressed table gets the cells in one pass over its runs, sorted by (from, to) here
+void RouteTable::setEntries(std::vector<RunCell<RouteEntry>>& cells) {
+	if (entries != NULL) {
+		for (auto iter = cells.cbegin(); iter != cells.cend(); iter++)
+			entries[size_t(iter->row) * numStations + iter->col] = iter->value;
+		return;
+	}
+	std::stable_sort(cells.begin(), cells.end(), cellBefore<RouteEntry>);
+	size_t n = 0;
+	for (size_t i = 0; i < cells.size(); i++) {
+		if (n > 0 && cells[n - 1].row == cells[i].row && cells[n - 1].col == cells[i].col)
+			n--;
+		cells[n++] = cells[i];
 	}
+	cells.resize(n);
+	compactEntries.setCells(cells, numStations, sameEntry);
+}
 
-	policy_offpeak = new int** [TOTAL_STATIONS];
-	for (int i = 0; i < TOTAL_STATIONS; i++) {
-		policy_offpeak[i] = new int* [TOTAL_STATIONS];
-		for (int j = 0; j < TOTAL_STATIONS; j++) {
-			policy_offpeak[i][j] = new int[MAX_POLICY_NUM];
-			for (int k = 0; k < MAX_POLICY_NUM; k++) {
-				policy_offpeak[i][j][k] = -1;
+void RouteTable::setCompressed(bool compressed) {
+	if (compressed == isCompressed())
+		return;
+	int N = numStations;
+	if (compressed) {
+		compactEntries.clear();
+		for (int from = 0; from < N; from++)
+			compactEntries.appendRow(entries + size_t(from) * N, N, sameEntry);
+		if (!closures.empty()) {
+			std::vector<TransferClosure> row(N);
+			for (int set = 0; set < 2; set++) {
+				compactClosures[set].clear();
+				for (int from = 0; from < N; from++) {
+					for (int to = 0; to < N; to++)
+						row[to] = closures[(size_t(from) * N + to) * 2 + set];
+					compactClosures[set].appendRow(row.data(), N, sameClosure);
+				}
 			}
 		}
+		std::vector<TransferClosure>().swap(closures);
+		delete[] memory;
+		memory = NULL;
+		entries = NULL;
+		return;
 	}
 
-	directions = new int* [TOTAL_STATIONS];
-	for (int i = 0; i < TOTAL_STATIONS; i++) {
-		directions[i] = new int[TOTAL_STATIONS];
-		for (int j = 0; j < TOTAL_STATIONS; j++) {
-			directions[i][j] = -1;
+	// fill the block run by run
+	allocate();
+	for (int from = 0; from < N; from++) {
+		for (int k = compactEntries.rowStart[from]; k < compactEntries.rowStart[from + 1]; k++) {
+			int end = (k + 1 < compactEntries.rowStart[from + 1]) ? compactEntries.firstCol[k + 1] : N;
+			for (int to = compactEntries.firstCol[k]; to < end; to++)
+				new (&entries[size_t(from) * N + to]) RouteEntry(compactEntries.values[k]);
 		}
 	}
+	if (compactClosures[0].rows() == N) {
+		closures.resize(size_t(N) * N * 2);
+		for (int set = 0; set < 2; set++) {
+			const RunMatrix<TransferClosure>& matrix = compactClosures[set];
+			for (int from = 0; from < N; from++) {
+				for (int k = matrix.rowStart[from]; k < matrix.rowStart[from + 1]; k++) {
+					int end = (k + 1 < matrix.rowStart[from + 1]) ? matrix.firstCol[k + 1] : N;
+					for (int to = matrix.firstCol[k]; to < end; to++)
+						closures[(size_t(from) * N + to) * 2 + set] = matrix.values[k];
+				}
+			}
+		}
+	}
+	compactEntries = RunMatrix<RouteEntry>();
+	compactClosures[0] = RunMatrix<TransferClosure>();
+	compactClosures[1] = RunMatrix<TransferClosure>();
+}
+
+size_t RouteTable::memoryBytes() const {
+	if (entries != NULL)
+		return bytes() + closures.size() * sizeof(TransferClosure);
+	return compactEntries.bytes() + compactClosures[0].bytes() + compactClosures[1].bytes();
+}
+
+// this is the function to load the data and initalize the Simulation 
+void Simulation::init(const std::string& dataDir, const std::string& cacheFile) {
+	// load the data, from the binary cache if it is up to date.
+	// the route table is created by both, when the number of stations is known,
+	// and is kept compressed if it is big
+	string cache_name = cacheFile.empty() ? dataDir + "/" + DATA_CACHE_FILE : cacheFile;
+	loadedFromCache = loadCache(dataDir, cache_name);
+	if (!loadedFromCache)
+		loadCSV(dataDir);
+	routes->setCompressed(numStations >= COMPRESS_ROUTES_FROM);
+	if (!loadedFromCache)
+		saveCache(dataDir, cache_name);
+	routes->buildClosure();
+	routingIndex = std::make_shared<RoutingIndex>(dataDir);
 
-	transferTime = new double* [TOTAL_STATIONS];
-	for (int i = 0; i < TOTAL_STATIONS; i++) {
-		transferTime[i] = new double[TOTAL_STATIONS];
-		for (int j = 0; j < TOTAL_STATIONS; j++) {
-			transferTime[i][j] = -1.0;
+	cout << "Start initializing the simulator...";
+	initTrains();
+
+	// reset using the loaded data
+	reset();
+}
+
+// init the iterators and the train pool, one train for each trainID
+void Simulation::initTrains() {
+	totalTrainNum = startTrainInfo.size();	// use startTranInfo to get the train number
+	for (int i = 0; i < totalTrainNum; i++) {
+		int trainID = startTrainInfo[i][0];
+		if (trainID < 0 || trainID >= totalTrainNum || trainID >= int(arrivalTime.size())) {
+			cout << "train " << trainID << " out of range!\n";
+			throw "The train IDs must be 0, 1, 2... as the rows of arrivalTime.csv!";
 		}
 	}
+	delete[] time_iter;
+	delete[] stationID_iter;
+	time_iter = new int[totalTrainNum];
+	stationID_iter = new int[totalTrainNum];
+	trains.assign(totalTrainNum, Train(-1, -1, 0, -1, 0.0));
+}
 
-	// then load the data
+// read the csv files and load the data into the tables
+void Simulation::loadCSV(const std::string& dataDir) {
+	std::string dir = dataDir + "/";
 	cout << "Reading disk";
-	// arrivalStationID
-	str_mat str_ASID =			readcsv("data/arrivalStationID.csv");	cout << ".";
-	str_mat str_AT =			readcsv("data/arrivalTime.csv");		cout << ".";
-	str_mat str_directions =	readcsv("data/directions.csv");			cout << ".";
-	str_mat str_policy =		readcsv("data/policy.csv");				cout << ".";
-	str_mat str_policy_offpeak =readcsv("data/policy2.csv");			cout << ".";
-	str_mat str_policy_num =	readcsv("data/policy_num.csv");			cout << ".";
-	str_mat str_STI =			readcsv("data/startTrainInfo.csv");		cout << ".";
-	str_mat str_stations =		readcsv("data/stations.csv");			cout << ".";
-	str_mat str_TT =			readcsv("data/transferTime.csv");		cout << ".";
-	str_mat str_fixedOD =		readcsv("data/fixedOD.csv");			cout << ".";
-	cout << "done\nLoading data";
-
-	// then load the data for each variable in turn
-	// str_ASID to arrivalStationID: str_mat to vector of vector of int
-	for (auto iter_row = str_ASID.cbegin(); iter_row != str_ASID.cend(); iter_row++)
-	{
-		vector<int> newASID;
-		for (auto iter_col = (*iter_row).cbegin(); iter_col != (*iter_row).cend(); iter_col++)
-		{
-			newASID.push_back(atoi((*iter_col).c_str()));
+	// stations: [stationID, lineID, isTerminal0, isTerminal1, isTransfer]
+	// read first, the number of stations decides the size of the route table
+	readcsv(dir + "stations.csv", [this](const CsvField* fields, int n) {
+		if (n < 5)
+			throw "A row of stations.csv must be [stationID, lineID, isTerminal0, isTerminal1, isTransfer]!";
+		Station newStation(fields[0].toInt(), fields[1].toInt(), fields[2].toBool(), fields[3].toBool(), fields[4].toBool());
+		stations.push_back(newStation);
+	});
+	numStations = int(stations.size());
+	for (int i = 0; i < numStations; i++) {
+		if (stations[i].ID != i) {
+			cout << "station " << stations[i].ID << " is at row " << i << " of stations.csv!\n";
+			throw "The station IDs must be 0, 1, 2... in order!";
 		}
-		arrivalStationID.push_back(newASID);
 	}
+	routes = std::make_shared<RouteTable>(numStations);
+	RouteTable* table = routes.get();
+	cout << ".";
 
-	// str_AT to arrivalTime: str_mat to vector of vector of double
-	for (auto iter_row = str_AT.cbegin(); iter_row != str_AT.cend(); iter_row++)
-	{
-		vector<double> newAT;
-		for (auto iter_col = (*iter_row).cbegin(); iter_col != (*iter_row).cend(); iter_col++)
-		{
-			newAT.push_back(atof((*iter_col).c_str()));
+	// each of the other files is loaded into its own table, or its own field of the route
+	// entries, so they can be read at the same time.
+	// the rows are parsed straight into the numbers, no string is made
+	std::vector<std::vector<int>> allOD;
+	std::vector<std::future<void>> jobs;
+
+	jobs.push_back(std::async(std::launch::async, [this, &dir] {
+		readcsv(dir + "arrivalStationID.csv", arrivalStationID);
+	}));
+	jobs.push_back(std::async(std::launch::async, [this, &dir] {
+		readcsv(dir + "arrivalTime.csv", arrivalTime);
+	}));
+
+	// check the station IDs of the compact formats, a wrong ID would write out of the table
+	int N = numStations;
+	auto checkOD = [N](int from, int to, const char* file_name) {
+		if (from < 0 || from >= N || to < 0 || to >= N) {
+			cout << "illegal OD pair from " << from << " to " << to << " in " << file_name << "!\n";
+			throw "Station ID out of range!";
 		}
-		arrivalTime.push_back(newAT);
-	}
+	};
 
-	// str_directions to directions: str_mat (compact format) to 2-d array
-	for (auto iter_row = str_directions.cbegin(); iter_row != str_directions.cend(); iter_row++)
-	{
-		int from = atoi((*iter_row)[0].c_str());
-		int to = atoi((*iter_row)[1].c_str());
-		int direction = atoi((*iter_row)[2].c_str());
-		directions[from][to] = direction;
+	// directions: compact format [from, to, direction]
+	jobs.push_back(std::async(std::launch::async, [table, checkOD, &dir] {
+		readcsv(dir + "directions.csv", [table, checkOD](const CsvField* fields, int n) {
+			if (n < 3)
+				throw "A row of directions.csv must be [from, to, direction]!";
+			int from = fields[0].toInt();
+			int to = fields[1].toInt();
+			checkOD(from, to, "directions.csv");
+			table->edit(from, to).direction = fields[2].toInt();
+		});
+	}));
+
+	// policy & policy_offpeak: compact format [from, to, next station 1, next station 2, ...]
+	jobs.push_back(std::async(std::launch::async, [table, checkOD, &dir] {
+		readcsv(dir + "policy.csv", [table, checkOD](const CsvField* fields, int n) {
+			if (n < 2)
+				throw "A row of policy.csv must be [from, to, next station 1, next station 2, ...]!";
+			int from = fields[0].toInt();
+			int to = fields[1].toInt();
+			checkOD(from, to, "policy.csv");
+			for (int index = 0; index < n - 2 && index < MAX_POLICY_NUM; index++)
+				table->edit(from, to).policy[index] = fields[index + 2].toInt();
+		});
+	}));
+	// policy2.csv can be left out (e.g. simple_data), then the peak policies are used all day
+	long long size, mtime;
+	bool hasOffpeak = getFileStamp((dir + "policy2.csv").c_str(), size, mtime);
+	if (hasOffpeak) {
+		jobs.push_back(std::async(std::launch::async, [table, checkOD, &dir] {
+			readcsv(dir + "policy2.csv", [table, checkOD](const CsvField* fields, int n) {
+				if (n < 2)
+					throw "A row of policy2.csv must be [from, to, next station 1, next station 2, ...]!";
+				int from = fields[0].toInt();
+				int to = fields[1].toInt();
+				checkOD(from, to, "policy2.csv");
+				for (int index = 0; index < n - 2 && index < MAX_POLICY_NUM; index++)
+					table->edit(from, to).policy_offpeak[index] = fields[index + 2].toInt();
+			});
+		}));
 	}
 
-	// str_policy to policy: str_mat (compact format) to 3-d array
-	for (auto iter_row = str_policy.cbegin(); iter_row != str_policy.cend(); iter_row++)
-	{
-		int from = atoi((*iter_row)[0].c_str());
-		int to = atoi((*iter_row)[1].c_str());
-		int index = 0;
-		auto iter_col = (*iter_row).cbegin();
-		iter_col++;
-		iter_col++;
-		while (iter_col != (*iter_row).cend()) {
-			policy[from][to][index] = atoi((*iter_col).c_str());
-			index++;
-			iter_col++;
+	// policy_num & transferTime: full matrices
+	jobs.push_back(std::async(std::launch::async, [table, N, &dir] {
+		int row = 0;
+		readcsv(dir + "policy_num.csv", [table, N, &row](const CsvField* fields, int n) {
+			if (n < N)
+				throw "A row of policy_num.csv must have a column for each station!";
+			for (int col = 0; col < N && row < N; col++)
+				table->edit(row, col).policy_num = fields[col].toInt();
+			row++;
+		});
+	}));
+	jobs.push_back(std::async(std::launch::async, [table, N, &dir] {
+		int row = 0;
+		readcsv(dir + "transferTime.csv", [table, N, &row](const CsvField* fields, int n) {
+			if (n < N)
+				throw "A row of transferTime.csv must have a column for each station!";
+			for (int col = 0; col < N && row < N; col++)
+				table->edit(row, col).transferTime = fields[col].toInt();
+			row++;
+		});
+	}));
+
+	jobs.push_back(std::async(std::launch::async, [this, &dir] {
+		readcsv(dir + "startTrainInfo.csv", startTrainInfo);
+	}));
+
+	jobs.push_back(std::async(std::launch::async, [&allOD, &dir] {
+		readcsv(dir + "fixedOD.csv", allOD);
+	}));
+
+	// wait for all the files, get() throws again the error in the reading thread
+	for (auto iter = jobs.begin(); iter != jobs.end(); iter++) {
+		iter->get();
+		cout << ".";
+	}
+	for (int from = 0; !hasOffpeak && from < N; from++) {
+		for (int to = 0; to < N; to++) {
+			for (int k = 0; k < MAX_POLICY_NUM; k++)
+				table->edit(from, to).policy_offpeak[k] = table->at(from, to).policy[k];
 		}
 	}
 
-	// str_policy_offpeak to policy_offpeak: str_mat (compact format) to 3-d array
-	for (auto iter_row = str_policy_offpeak.cbegin(); iter_row != str_policy_offpeak.cend(); iter_row++)
-	{
-		int from = atoi((*iter_row)[0].c_str());
-		int to = atoi((*iter_row)[1].c_str());
-		int index = 0;
-		auto iter_col = (*iter_row).cbegin();
-		iter_col++;
-		iter_col++;
-		while (iter_col != (*iter_row).cend()) {
-			policy_offpeak[from][to][index] = atoi((*iter_col).c_str());
-			index++;
-			iter_col++;
-		}
+	// filter the od between the transfer stations...
+	for (auto iter_row = allOD.cbegin(); iter_row != allOD.cend(); iter_row++) {
+		checkOD((*iter_row)[0], (*iter_row)[1], "fixedOD.csv");
+		if (table->at((*iter_row)[0], (*iter_row)[1]).transferTime == -1)
+			fixedOD.push_back(*iter_row);
 	}
+	cout << "done\n";
+}
 
-	// str_policy_num to policy_num & str_TT to transferTime
-	for (int row = 0; row < TOTAL_STATIONS; row++) {
-		for (int col = 0; col < TOTAL_STATIONS; col++) {
-			policy_num[row][col] = atoi((str_policy_num[row][col]).c_str());
-			transferTime[row][col] = atoi((str_TT[row][col]).c_str());
-		}
+// share the data loaded by another simulator, so that several simulators can work in one process
+// without reading the disk again. The shared data are never changed during the simulation,
+// the tables are shared and the others are copied.
+void Simulation::init(const Simulation& loaded) {
+	numStations = loaded.numStations;
+	// the loaded routes and timetable, without the closures and incidents of 'loaded'
+	routes = loaded.loadedRoutes ? loaded.loadedRoutes : loaded.routes;
+
+	startTrainInfo = loaded.startTrainInfo;
+	arrivalTime = loaded.arrivalTime;
+	arrivalStationID = loaded.arrivalStationID;
+	for (auto iter = loaded.incidentEdits.crbegin(); iter != loaded.incidentEdits.crend(); iter++)
+		setTrip(*iter);
+	stations = loaded.stations;
+	fixedOD = loaded.fixedOD;
+	routingIndex = loaded.routingIndex;
+
+	initTrains();
+	reset();
+}
+
+// copy the whole state of 'live', which must share the data with this simulator (one of them
+// init() from the other, or both from the same one). like restore() from a snapshot of 'live',
+// without making the snapshot. the random engine is copied too, so the same actions give the
+// same results as 'live' would get
+void Simulation::cloneState(const Simulation& live) {
+	if (live.numStations != numStations || live.totalTrainNum != totalTrainNum) {
+		cout << "can't clone a simulator of other data!\n";
+		throw "Invalid simulator to clone!";
 	}
-	// str_STI to startTrainInfo
-	for (auto iter_row = str_STI.cbegin(); iter_row != str_STI.cend(); iter_row++)
-	{
-		vector<int> newTrain;
-		for (auto iter_col = (*iter_row).cbegin(); iter_col != (*iter_row).cend(); iter_col++)
-		{
-			newTrain.push_back(atoi((*iter_col).c_str()));
+	time = live.time;
+	_last_time = live._last_time;
+	totalTravelTime = live.totalTravelTime;
+	totalDelay = live.totalDelay;
+	num_departed = live.num_departed;
+	num_arrived = live.num_arrived;
+	numEvents = live.numEvents;
+	nextKey = live.nextKey;
+	keyOrder = live.keyOrder;
+
+	// the train handles in the events point into the pool of 'live', point them into ours
+	delete EventQueue;
+	EventQueue = live.EventQueue->clone();
+	EventQueue->forEach([this](Event& event) {
+		if (event.type == ARRIVAL) {
+			Train* train = &trains[event.train->trainID];
+			*train = *(event.train);
+			event.train = train;
 		}
-		startTrainInfo.push_back(newTrain);
-	}
+	});
 
-	// str_stations to stations
-	for (auto iter_row = str_stations.cbegin(); iter_row != str_stations.cend(); iter_row++)
-	{
-		int stationID = atoi((*iter_row)[0].c_str());
-		int lineID = atoi((*iter_row)[1].c_str());
-		bool isTerminal0 = str2bool((*iter_row)[2]);
-		bool isTerminal1 = str2bool((*iter_row)[3]);
-		bool isTransfer = str2bool((*iter_row)[4]);
+	stations = live.stations;
+	queues = live.queues;
+	rng = live.rng;
 
-		Station newStation(stationID, lineID, isTerminal0, isTerminal1, isTransfer);
-		stations.push_back(newStation);
-	}
+	// the timetable with the same incidents
+	undoIncidents();
+	for (auto iter = live.incidentEdits.cbegin(); iter != live.incidentEdits.cend(); iter++)
+		setTrip(live.getTrip(iter->row));
+	incidentEdits = live.incidentEdits;
+	routes = live.routes;
+	loadedRoutes = live.loadedRoutes;
+	routingGraph = live.routingGraph;	// never changed once built
+	closedLinks = live.closedLinks;
+	closedStations = live.closedStations;
+	std::copy(live.time_iter, live.time_iter + totalTrainNum, time_iter);
+	std::copy(live.stationID_iter, live.stationID_iter + totalTrainNum, stationID_iter);
+	STATS(stats.clear(numStations));
+	updateSlice();
+}
 
-	// str_fixedOD to fixedOD
-	for (auto iter_row = str_fixedOD.cbegin(); iter_row != str_fixedOD.cend(); iter_row++)
-	{
-		vector<int> newOD;
-		for (auto iter_col = (*iter_row).cbegin(); iter_col != (*iter_row).cend(); iter_col++)
-		{
-			newOD.push_back(atoi((*iter_col).c_str()));
+Simulation::Simulation() : time(0), totalTravelTime(0), totalDelay(0), num_departed(0), num_arrived(0), numEvents(0), \
+	loadedFromCache(false), nextKey(0), EventQueue(EventScheduler::create(DEFAULT_SCHEDULER)), keyOrder(false), \
+	time_iter(NULL), stationID_iter(NULL), \
+	rng(std::random_device()()), slice(0), sliceEnd(0.0), sliceRoutes(NULL), slicePeak(true), fluidRecord(NULL) {}
+
+// free the event queue, the iterators and the snapshots, the trains are freed with the pool.
+// the route table is freed by the last simulator using it
+Simulation::~Simulation() {
+	delete EventQueue;
+	delete[] time_iter;
+	delete[] stationID_iter;
+	for (auto iter = snapshots.begin(); iter != snapshots.end(); iter++)
+		delete *iter;
+}
+
+void Simulation::seed(unsigned int s, unsigned long long stream) {
+	rng.seed(s, stream);
+}
+
+// the event gets the next key, so in key order the events added at the same time are handled in that order
+void Simulation::addEvent(Event newevent) {
+	if (newevent.type == ARRIVAL && newevent.train != NULL)
+		newevent.key = arrivalKey(newevent.train->trainID);
+	else
+		newevent.key = (newevent.type == SUSPEND) ? suspendKey(nextKey++) : odKey(nextKey++);
+	EventQueue->push(newevent);
+}
+
+// add n groups of passengers at once, group i is (t[i], from[i], to[i], num[i]). The whole
+// batch is checked before any of it is added, then inserted in one go
+void Simulation::addODBatch(const double* t, const int* from, const int* to, const int* num, size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		if (!(t[i] >= 0) || from[i] < 0 || from[i] >= numStations || to[i] < 0 || to[i] >= numStations || num[i] < 0) {
+			cout << "invalid OD " << i << ": " << t[i] << " " << from[i] << " " << to[i] << " " << num[i] << "\n";
+			throw "Invalid OD in the batch!";
 		}
-		// filter the od between the transfer stations...
-		if (transferTime[newOD[0]][newOD[1]] == -1)
-			fixedOD.push_back(newOD);
 	}
 
-	// init the iterators
-	totalTrainNum = str_STI.size();	// use startTranInfo to get the train number
-	time_iter = new int[totalTrainNum];
-	stationID_iter = new int[totalTrainNum];
-	cout << "done\nStart initializing the simulator...";
+	std::vector<Event> batch;
+	batch.reserve(n);
+	for (size_t i = 0; i < n; i++) {
+		Event newODEvent(t[i], NEW_OD, false);
+		newODEvent.key = odKey(nextKey++);
+		newODEvent.from = from[i];
+		newODEvent.to = to[i];
+		newODEvent.num = num[i];
+		batch.push_back(newODEvent);
+	}
+	// the queue pops the batch exactly as if addEvent() had been called for each group. in key order
+	// the keys are given in the order of the groups, so the batch is sorted and the heap can be
+	// built again at once. otherwise the groups at the same time are served in the order of the
+	// pushes (or of the layout of the binary heap), so they are pushed in the order given
+	if (keyOrder)
+		std::sort(batch.begin(), batch.end(), eventBefore);
+	EventQueue->pushBatch(batch);
+}
 
-	// reset using the loaded data
-	reset();
+// move the events to a queue of another implementation, e.g. to compare the speed
+void Simulation::setScheduler(SchedulerType type) {
+	EventScheduler* newQueue = EventScheduler::create(type, keyOrder);
+	while (!EventQueue->empty())
+		newQueue->push(EventQueue->pop());
+	delete EventQueue;
+	EventQueue = newQueue;
+}
+
+// the queue is made again in the new order. the keys are always given, so it can be turned on
+// at any time, e.g. on a copy of a simulator to compare it with ParallelEngine
+void Simulation::setKeyOrder(bool on) {
+	keyOrder = on;
+	setScheduler(EventQueue->type);
 }
 
 // reset/init the simulation state using loaded data.
@@ -193,12 +462,15 @@ void Simulation::reset() {
 	totalDelay = 0.0;
 	num_departed = 0;
 	num_arrived = 0;
+	numEvents = 0;
+	nextKey = 0;
 
-	// #################################
-	// clear the events, maybe very slow
-	// #################################
-	while (!EventQueue.empty())
-		EventQueue.pop();
+	// clear the events, and go back to the loaded timetable and routes
+	EventQueue->clear();
+	undoIncidents();
+	closedLinks.clear();
+	closedStations.clear();
+	updateRoutes();
 
 	// reset the iterators
 	for (int i = 0; i < totalTrainNum; i++) {
@@ -206,7 +478,8 @@ void Simulation::reset() {
 		stationID_iter[i] = 0;
 	}
 
-	// renew the start out trains
+	// renew the start out trains, the trains in the pool are reused, so the trains left
+	// from the last run need no freeing and nothing is allocated
 	for (int i = 0; i < totalTrainNum; i++) {
 		int trainID = startTrainInfo[i][0];
 		int startingStationID = startTrainInfo[i][1];
@@ -215,10 +488,21 @@ void Simulation::reset() {
 		int capacity = startTrainInfo[i][4];
 		double startTime = startTrainInfo[i][5];
 
-		Train* newTrain = new Train(trainID, lineID, direction, startingStationID, startTime, capacity);
+		Train* newTrain = &trains[trainID];
+		newTrain->trainID = trainID;
+		newTrain->lineID = lineID;
+		newTrain->direction = direction;
+		newTrain->arrivingStation = startingStationID;
+		newTrain->lastTime = startTime;
+		newTrain->capacity = capacity;
+		newTrain->passengerNum = 0;
+		newTrain->destination.clear();	// keep the memory for the next run
+		newTrain->numODs = 0;
+
 		Event newEvent(startTime, ARRIVAL);
+		newEvent.key = arrivalKey(trainID);
 		newEvent.train = newTrain;
-		EventQueue.push(newEvent);
+		EventQueue->push(newEvent);
 	}
 
 	// renew the fixed OD pairs
@@ -229,20 +513,17 @@ void Simulation::reset() {
 		int number = (*iter_row)[2];
 		int time = (*iter_row)[3];
 		Event newODEvent(double(time), NEW_OD, false);
+		newODEvent.key = odKey(nextKey++);
 		newODEvent.from = O;
 		newODEvent.to = D;
 		newODEvent.num = number;
-		EventQueue.push(newODEvent);
+		EventQueue->push(newODEvent);
 	}
 
-	// renew the stations (queues)
-	for (int i = 0; i < TOTAL_STATIONS; i++) {
-		// reset the queues, maybe a bit slow
-		while (!stations[i].queue[0].empty())
-			stations[i].queue[0].pop();
-		while (!stations[i].queue[1].empty())
-			stations[i].queue[1].pop();
-
+	// renew the stations, the queues are emptied at once
+	queues.reset(numStations * 2);
+	STATS(stats.clear(numStations));
+	for (int i = 0; i < numStations; i++) {
 		// reset avg_inStationTime
 		stations[i].queueSize[0] = 0;
 		stations[i].queueSize[1] = 0;
@@ -253,4 +534,99 @@ void Simulation::reset() {
 		stations[i].numPass[0] = 0;
 		stations[i].numPass[1] = 0;
 	}
-}
\ No newline at end of file
+}
+
+// save the current state of the simulation, return the handle to restore() it later.
+// the trains are copied, so the snapshot is not affected by the following simulation.
+int Simulation::snapshot() {
+	SimState* state = new SimState;
+	state->time = time;
+	state->_last_time = _last_time;
+	state->totalTravelTime = totalTravelTime;
+	state->totalDelay = totalDelay;
+	state->num_departed = num_departed;
+	state->num_arrived = num_arrived;
+	state->numEvents = numEvents;
+	state->nextKey = nextKey;
+	state->keyOrder = keyOrder;
+
+	// copy the event queue as it is, and the trains on the way. The train handles in the
+	// events point into the train pool, which stays at the same place, so they are kept
+	state->events = EventQueue->clone();
+	state->events->forEach([state](Event& event) {
+		if (event.type == ARRIVAL)
+			state->trains.push_back(*(event.train));
+	});
+
+	state->stations = stations;
+	state->queues = queues;
+	state->rng = rng;
+	state->edits = incidentEdits;
+	for (auto iter = incidentEdits.cbegin(); iter != incidentEdits.cend(); iter++)
+		state->editedTrips.push_back(getTrip(iter->row));
+	state->routes = routes;
+	state->loadedRoutes = loadedRoutes;
+	state->closedLinks = closedLinks;
+	state->closedStations = closedStations;
+	state->time_iter.assign(time_iter, time_iter + totalTrainNum);
+	state->stationID_iter.assign(stationID_iter, stationID_iter + totalTrainNum);
+
+	snapshots.push_back(state);
+	return int(snapshots.size()) - 1;
+}
+
+// go back to the state saved by snapshot(), the snapshot can be restored for many times
+void Simulation::restore(int handle) {
+	if (handle < 0 || handle >= int(snapshots.size()) || snapshots[handle] == NULL) {
+		cout << "snapshot " << handle << " not existing!\n";
+		throw "Invalid snapshot!";
+	}
+	SimState* state = snapshots[handle];
+
+	time = state->time;
+	_last_time = state->_last_time;
+	totalTravelTime = state->totalTravelTime;
+	totalDelay = state->totalDelay;
+	num_departed = state->num_departed;
+	num_arrived = state->num_arrived;
+	numEvents = state->numEvents;
+	nextKey = state->nextKey;
+	keyOrder = state->keyOrder;
+
+	// the order of the queue is kept, so there is no need to sort again
+	delete EventQueue;
+	EventQueue = state->events->clone();
+	for (auto iter = state->trains.cbegin(); iter != state->trains.cend(); iter++)
+		trains[iter->trainID] = *iter;
+
+	stations = state->stations;
+	queues = state->queues;
+	rng = state->rng;
+
+	// the timetable as it was, the trips changed by the incidents are put back
+	undoIncidents();
+	routes = state->routes;
+	loadedRoutes = state->loadedRoutes;
+	closedLinks = state->closedLinks;
+	closedStations = state->closedStations;
+	for (auto iter = state->editedTrips.cbegin(); iter != state->editedTrips.cend(); iter++)
+		setTrip(*iter);
+	incidentEdits = state->edits;
+	std::copy(state->time_iter.begin(), state->time_iter.end(), time_iter);
+	std::copy(state->stationID_iter.begin(), state->stationID_iter.end(), stationID_iter);
+	updateSlice();
+
+	// the counters start again, as after reset()
+	STATS(stats.clear(numStations));
+}
+
+SimState::~SimState() {
+	delete events;
+}
+
+void Simulation::releaseSnapshot(int handle) {
+	if (handle < 0 || handle >= int(snapshots.size()))
+		return;
+	delete snapshots[handle];
+	snapshots[handle] = NULL;
+}
@@ -0,0 +1,382 @@
+//Header Files
+#include "util.hpp"
+#include "ParallelEngine.hpp"
+#include "Scheduler.hpp"
+#include "EventLog.hpp"
+#include <limits>
+#include <exception>
+
+// the event queue of a partition during a run: its own events go into the queue of the simulator,
+// the transfer events of the other partitions into the mailboxes, and the end of the window
+// comes out as a suspend, so Simulation::run() stops there without knowing about the partitions
+class PartitionQueue : public EventScheduler {
+public:
+	PartitionQueue(EventScheduler* inner, int self, const std::vector<int>& stationPart, int numPartitions, double start) : \
+		EventScheduler(inner->type, inner->byKey), inner(inner), self(self), stationPart(stationPart), windowEnd(0.0), \
+		lastTime(start), numSuspends(0), outbox(numPartitions) {}
+
+	void push(const Event& newevent) {
+		int owner = ownerOf(newevent);
+		if (owner == self)
+			inner->push(newevent);
+		else
+			outbox[owner].push_back(newevent);
+	}
+	Event pop() {
+		if (inner->empty() || inner->nextTime() >= windowEnd) {
+			numSuspends++;
+			return Event(windowEnd, SUSPEND);
+		}
+		Event nextevent = inner->pop();
+		lastTime = nextevent.time;
+		return nextevent;
+	}
+	double nextTime() { return (inner->empty() || inner->nextTime() >= windowEnd) ? windowEnd : inner->nextTime(); }
+	bool empty() const { return false; }	// there is always the end of the window
+	size_t size() const { return inner->size(); }
+	void clear() { inner->clear(); }
+	EventScheduler* clone() const { return inner->clone(); }
+	void forEach(const std::function<void(Event&)>& visit) { inner->forEach(visit); }
+
+	// the partition handling the event, the trains never leave theirs
+	int ownerOf(const Event& event) const {
+		if (event.type != NEW_OD || event.from < 0 || event.from >= int(stationPart.size()))
+			return self;
+		return stationPart[event.from];
+	}
+
+	EventScheduler* inner;		// the queue of the simulator, not owned
+	int self;
+	const std::vector<int>& stationPart;
+	double windowEnd;
+	double lastTime;			// of the last event handled, the ends of the windows are not events
+	long long numSuspends;		// the ends of the windows given to run(), not counted as events
+	std::vector<std::vector<Event>> outbox;		// [to partition], only written by the thread of this one
+};
+
+ParallelEngine::ParallelEngine(int numThreads) : numWindows(0), numMessages(0), pool(numThreads), source(NULL), \
+	numPartitions(0), window(0.0) {}
+
+ParallelEngine::~ParallelEngine() {
+	release();
+	for (auto iter = sims.begin(); iter != sims.end(); iter++)
+		delete *iter;
+}
+
+void ParallelEngine::makePartitions(const Simulation& sim, int requested) {
+	int N = sim.numStations;
+	std::vector<int> lineIDs;
+	for (int i = 0; i < N; i++)
+		lineIDs.push_back(sim.stations[i].lineID);
+	std::sort(lineIDs.begin(), lineIDs.end());
+	lineIDs.erase(std::unique(lineIDs.begin(), lineIDs.end()), lineIDs.end());
+	int numLines = int(lineIDs.size());
+	auto lineOf = [&](int station) {
+		return int(std::lower_bound(lineIDs.begin(), lineIDs.end(), sim.stations[station].lineID) - lineIDs.begin());
+	};
+
+	// put the lines a train runs on into one group, and count the arrivals of each line
+	std::vector<int> parent(numLines);
+	for (int k = 0; k < numLines; k++)
+		parent[k] = k;
+	auto root = [&parent](int k) {
+		while (parent[k] != k)
+			k = parent[k] = parent[parent[k]];
+		return k;
+	};
+	std::vector<long long> load(numLines, 0);
+	std::vector<int> trainLine(sim.totalTrainNum, -1);
+	for (int i = 0; i < sim.totalTrainNum; i++) {
+		int trainID = sim.startTrainInfo[i][0];
+		int start = sim.startTrainInfo[i][1];
+		if (start < 0 || start >= N)
+			continue;
+		int line = lineOf(start);
+		trainLine[trainID] = line;
+		const std::vector<int>& stops = sim.arrivalStationID[trainID];
+		for (auto iter = stops.cbegin(); iter != stops.cend(); iter++) {
+			if (*iter >= 0 && *iter < N)
+				parent[root(lineOf(*iter))] = root(line);
+		}
+		load[line] += stops.size() + 1;
+	}
+
+	// the groups in the order of their first line, the heaviest first into the lightest partition
+	std::vector<int> group(numLines, -1);
+	std::vector<long long> groupLoad;
+	for (int k = 0; k < numLines; k++) {
+		int r = root(k);
+		if (group[r] < 0) {
+			group[r] = int(groupLoad.size());
+			groupLoad.push_back(0);
+		}
+		group[k] = group[r];
+		groupLoad[group[k]] += load[k];
+	}
+	int numGroups = int(groupLoad.size());
+	numPartitions = (requested <= 0 || requested > numGroups) ? numGroups : requested;
+	if (numPartitions < 1)
+		numPartitions = 1;
+
+	std::vector<int> order(numGroups);
+	for (int g = 0; g < numGroups; g++)
+		order[g] = g;
+	std::stable_sort(order.begin(), order.end(), [&groupLoad](int left, int right) {
+		return groupLoad[left] > groupLoad[right];
+	});
+	std::vector<int> groupPart(numGroups, 0);
+	std::vector<long long> partLoad(numPartitions, 0);
+	for (auto iter = order.cbegin(); iter != order.cend(); iter++) {
+		int lightest = int(std::min_element(partLoad.begin(), partLoad.end()) - partLoad.begin());
+		groupPart[*iter] = lightest;
+		partLoad[lightest] += groupLoad[*iter];
+	}
+
+	stationPart.assign(N, 0);
+	for (int i = 0; i < N; i++)
+		stationPart[i] = groupPart[group[lineOf(i)]];
+	trainPart.assign(sim.totalTrainNum, 0);
+	for (int t = 0; t < sim.totalTrainNum; t++) {
+		if (trainLine[t] >= 0)
+			trainPart[t] = groupPart[group[trainLine[t]]];
+	}
+}
+
+double ParallelEngine::findLookahead(const Simulation& sim) {
+	double shortest = std::numeric_limits<double>::infinity();
+	if (numPartitions == 1)
+		return shortest;
+
+	// the walks between two stations of different partitions, any longer walk has one of them.
+	// a compressed table is looked at run by run, only the runs of transfers are opened
+	RouteTable& table = *sim.routes;
+	int N = table.size();
+	auto check = [&](int from, int to, double transferTime) {
+		if (transferTime != -1 && stationPart[from] != stationPart[to] && transferTime < shortest)
+			shortest = transferTime;
+	};
+	if (!table.isCompressed()) {
+		for (int from = 0; from < N; from++) {
+			for (int to = 0; to < N; to++)
+				check(from, to, table.at(from, to).transferTime);
+		}
+		return shortest;
+	}
+	const RunMatrix<RouteEntry>& runs = table.compressedEntries();
+	for (int from = 0; from < N; from++) {
+		for (int k = runs.rowStart[from]; k < runs.rowStart[from + 1]; k++) {
+			if (runs.values[k].transferTime == -1)
+				continue;
+			int end = (k + 1 < runs.rowStart[from + 1]) ? runs.firstCol[k + 1] : N;
+			for (int to = runs.firstCol[k]; to < end; to++)
+				check(from, to, runs.values[k].transferTime);
+		}
+	}
+	return shortest;
+}
+
+Report ParallelEngine::run(Simulation& sim, int requested) {
+	makePartitions(sim, requested);
+	window = findLookahead(sim);
+	if (window <= 0.0) {
+		cout << "a transfer between two lines takes no time, the lines are run on one partition\n";
+		makePartitions(sim, 1);
+		window = findLookahead(sim);
+	}
+	numWindows = 0;
+	numMessages = 0;
+
+	// the run stops at the first suspend point like run(), the later ones are kept for the next
+	std::vector<Event> suspends;
+	sim.EventQueue->forEach([&suspends](Event& event) {
+		if (event.type == SUSPEND)
+			suspends.push_back(event);
+	});
+	std::sort(suspends.begin(), suspends.end(), eventBefore);
+	double suspendTime = suspends.empty() ? std::numeric_limits<double>::infinity() : suspends[0].time;
+	double stopTime = (suspendTime < SIMULATION_END_TIME) ? suspendTime : SIMULATION_END_TIME;
+
+	// each partition starts from a copy of the state with its own events only
+	try {
+		if (source != &sim) {
+			for (auto iter = sims.begin(); iter != sims.end(); iter++)
+				delete *iter;
+			sims.clear();
+			source = &sim;
+		}
+		while (int(sims.size()) < numPartitions) {
+			Simulation* part = new Simulation;
+			part->init(sim);
+			sims.push_back(part);
+		}
+		for (int p = 0; p < numPartitions; p++) {
+			Simulation& part = *sims[p];
+			part.cloneState(sim);
+			for (int t = 0; t < sim.totalTrainNum; t++)
+				part.trains[t] = sim.trains[t];		// the trains not in any event too, for exportState()
+			part.totalTravelTime = 0.0;
+			part.totalDelay = 0.0;
+			part.num_departed = 0;
+			part.num_arrived = 0;
+			part.numEvents = 0;
+
+			std::vector<Event> events;
+			part.EventQueue->forEach([&events](Event& event) {
+				events.push_back(event);
+			});
+			part.EventQueue->clear();
+			part.setKeyOrder(true);
+			PartitionQueue* queue = new PartitionQueue(part.EventQueue, p, stationPart, numPartitions, sim.time);
+			for (auto iter = events.cbegin(); iter != events.cend(); iter++) {
+				if (iter->type == SUSPEND)
+					continue;
+				int owner = (iter->type == ARRIVAL) ? trainPart[iter->train->trainID] : queue->ownerOf(*iter);
+				if (owner == p)
+					part.EventQueue->push(*iter);
+			}
+			part.EventQueue = queue;
+			queues.push_back(queue);
+		}
+
+		double start = earliest();
+		while (start < stopTime) {
+			runWindow((start + window < stopTime) ? start + window : stopTime);
+			deliver();
+			numWindows++;
+			start = earliest();
+		}
+
+		// run() goes on until the first event at or after the end of the day, so the partition
+		// of the first one by eventBefore() handles it
+		double next = earliest();
+		bool suspended = (suspendTime < SIMULATION_END_TIME || (suspendTime <= next && !suspends.empty()));
+		if (!suspended && next < std::numeric_limits<double>::infinity()) {
+			int first = -1;
+			Event firstEvent(next);
+			for (int p = 0; p < numPartitions; p++) {
+				EventScheduler* inner = queues[p]->inner;
+				if (inner->empty() || inner->nextTime() != next)
+					continue;
+				Event event = inner->pop();
+				inner->push(event);
+				if (first < 0 || eventBefore(event, firstEvent)) {
+					first = p;
+					firstEvent = event;
+				}
+			}
+			queues[first]->windowEnd = std::numeric_limits<double>::infinity();
+			sims[first]->run();
+			deliver();
+		}
+
+		// put the state back, each station and train from its own partition
+		double lastTime = sim.time;
+		for (int p = 0; p < numPartitions; p++) {
+			Simulation& part = *sims[p];
+			for (int s = 0; s < sim.numStations; s++) {
+				if (stationPart[s] != p)
+					continue;
+				sim.stations[s] = part.stations[s];
+				sim.queues.assign(s * 2, part.queues);
+				sim.queues.assign(s * 2 + 1, part.queues);
+			}
+			for (int t = 0; t < sim.totalTrainNum; t++) {
+				if (trainPart[t] != p)
+					continue;
+				sim.trains[t] = part.trains[t];
+				sim.time_iter[t] = part.time_iter[t];
+				sim.stationID_iter[t] = part.stationID_iter[t];
+			}
+			sim.totalTravelTime += part.totalTravelTime;
+			sim.totalDelay += part.totalDelay;
+			sim.num_departed += part.num_departed;
+			sim.num_arrived += part.num_arrived;
+			sim.numEvents += part.numEvents - queues[p]->numSuspends;
+			if (queues[p]->lastTime > lastTime)
+				lastTime = queues[p]->lastTime;
+		}
+
+		sim.EventQueue->clear();
+		for (int p = 0; p < numPartitions; p++) {
+			queues[p]->forEach([&sim](Event& event) {
+				if (event.type == ARRIVAL)
+					event.train = &sim.trains[event.train->trainID];
+				sim.EventQueue->push(event);
+			});
+		}
+		for (size_t k = suspended ? 1 : 0; k < suspends.size(); k++)
+			sim.EventQueue->push(suspends[k]);
+
+		// like run(): at the suspend point, or at the last event handled (the one at or after the
+		// end of the day, or the last of all if the queue is empty)
+		sim.time = suspended ? suspendTime : lastTime;
+		sim._last_time = sim.time;
+		if (!suspended && next == std::numeric_limits<double>::infinity())
+			eventLog().log(LOG_EMPTY_QUEUE, sim.time);
+		sim.updateSlice();
+	}
+	catch (...) {
+		release();
+		throw;
+	}
+	release();
+	return sim.report();
+}
+
+void ParallelEngine::runWindow(double windowEnd) {
+	std::vector<std::exception_ptr> errors(numPartitions);
+	for (int p = 0; p < numPartitions; p++)
+		queues[p]->windowEnd = windowEnd;
+	pool.parallelFor(numPartitions, [&](int p) {
+		EventScheduler* inner = queues[p]->inner;
+		if (inner->empty() || inner->nextTime() >= windowEnd)
+			return;
+		try {
+			sims[p]->run();
+		}
+		catch (...) {
+			// whatever a partition throws (a message or a std::exception) is thrown again after
+			// all of them stop, the first partition's first
+			errors[p] = std::current_exception();
+		}
+	});
+	for (int p = 0; p < numPartitions; p++) {
+		if (errors[p])
+			std::rethrow_exception(errors[p]);
+	}
+}
+
+// the mailboxes of a partition are merged in the order of eventBefore() and pushed at once. the
+// keys of the events are unique, so the queue serves them as run() would have in any case
+void ParallelEngine::deliver() {
+	std::vector<Event> incoming;
+	for (int to = 0; to < numPartitions; to++) {
+		incoming.clear();
+		for (int from = 0; from < numPartitions; from++) {
+			std::vector<Event>& mailbox = queues[from]->outbox[to];
+			incoming.insert(incoming.end(), mailbox.begin(), mailbox.end());
+			numMessages += mailbox.size();
+			mailbox.clear();
+		}
+		std::sort(incoming.begin(), incoming.end(), eventBefore);
+		queues[to]->inner->pushBatch(incoming);
+	}
+}
+
+double ParallelEngine::earliest() {
+	double first = std::numeric_limits<double>::infinity();
+	for (int p = 0; p < numPartitions; p++) {
+		EventScheduler* inner = queues[p]->inner;
+		if (!inner->empty() && inner->nextTime() < first)
+			first = inner->nextTime();
+	}
+	return first;
+}
+
+void ParallelEngine::release() {
+	for (size_t p = 0; p < queues.size(); p++) {
+		sims[p]->EventQueue = queues[p]->inner;
+		delete queues[p];
+	}
+	queues.clear();
+}
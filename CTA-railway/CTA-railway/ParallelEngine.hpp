@@ -0,0 +1,59 @@
+#pragma once
+#include "Simulation.hpp"
+#include "ThreadPool.hpp"
+
+// An optional way to run a simulator with its lines on several threads. The lines only meet
+// through the transfer passengers, who walk between two lines for at least the shortest
+// transfer time before they get into the queue of the other line. So the stations and trains
+// are cut into partitions by line (the lines a train runs on stay together), each partition
+// handles its own events on a copy of the simulator, and all of them go forward window by
+// window: from the earliest event T to T + the shortest transfer time between two partitions
+// (the lookahead), nothing sent by another partition can arrive. The transfer events for
+// another partition are put into the mailbox of the pair (written by one thread only, so no
+// lock is needed) and delivered at the end of the window.
+// The partitions run in key order (see Simulation::setKeyOrder()), so the result is the same as
+// run() in key order to the last bit, whatever the partitions and threads: each partition handles
+// its events in the order of eventBefore() (the keys come from the events, not from the queues),
+// the random route choices of an event come from the event (see CounterRNG::moveTo()), and the
+// amounts of the totals are rounded so that they add up exactly. run() in the default order can
+// handle the events at the same second in another order and draw other random numbers, so its
+// day is a little different.
+
+class PartitionQueue;		// the event queue of a partition, see ParallelEngine.cpp
+
+class ParallelEngine {
+public:
+	ParallelEngine(int numThreads = 0);		// 0 means one thread per core
+	~ParallelEngine();
+	ParallelEngine(const ParallelEngine&) = delete;
+	ParallelEngine& operator=(const ParallelEngine&) = delete;
+
+	// run 'sim' to its next suspend point or the end of the day as sim.run() does, and put the
+	// state back into it. numPartitions <= 0 gives each group of lines its own partition.
+	// a transfer taking no time leaves the lines together on one partition
+	Report run(Simulation& sim, int numPartitions = 0);
+
+	// about the last run
+	int partitionCount() const { return numPartitions; }
+	int threadCount() { return pool.size(); }
+	double lookahead() const { return window; }	// sec, infinity with one partition
+	long long numWindows;		// the times the partitions waited for each other
+	long long numMessages;		// the transfer events sent from a partition to another
+
+private:
+	ThreadPool pool;
+	std::vector<Simulation*> sims;		// one for each partition, kept between the runs
+	std::vector<PartitionQueue*> queues;	// their event queues during a run
+	const Simulation* source;			// the simulator 'sims' share the data with
+	int numPartitions;
+	double window;
+	std::vector<int> stationPart;		// the partition of each station
+	std::vector<int> trainPart;			// the partition of each train, by trainID
+
+	void makePartitions(const Simulation& sim, int requested);	// group the lines into partitions
+	double findLookahead(const Simulation& sim);	// the shortest transfer time between two partitions
+	void runWindow(double windowEnd);	// run all the partitions with events before the end
+	void deliver();						// move the mailboxes into the queues
+	double earliest();					// the time of the first event of all partitions
+	void release();						// give the simulators their own queues back
+};
@@ -0,0 +1,94 @@
+//Header Files
+#include "util.hpp"
+#include "Replications.hpp"
+#include "ThreadPool.hpp"
+#include <atomic>
+
+// summarize the samples, using the normal approximation for the confidence interval
+static Statistic summarize(const std::vector<double>& samples) {
+	Statistic stat = { 0.0, 0.0, 0.0 };
+	size_t n = samples.size();
+	if (n == 0)
+		return stat;
+	for (auto iter = samples.cbegin(); iter != samples.cend(); iter++)
+		stat.mean += *iter;
+	stat.mean /= double(n);
+	if (n > 1) {
+		double sum = 0.0;
+		for (auto iter = samples.cbegin(); iter != samples.cend(); iter++)
+			sum += (*iter - stat.mean) * (*iter - stat.mean);
+		stat.stdDev = sqrt(sum / double(n - 1));
+		stat.ci95 = 1.96 * stat.stdDev / sqrt(double(n));
+	}
+	return stat;
+}
+
+ReplicationReport runReplications(const Simulation& loaded, int numReplications, unsigned int seed, \
+	int numThreads, const ScenarioSetup& setup, std::vector<Report>* reports) {
+	std::vector<Report> results(numReplications > 0 ? numReplications : 0);
+	ThreadPool pool(numThreads);
+	int numWorkers = pool.size() < numReplications ? pool.size() : numReplications;
+
+	// each thread keeps one simulator and takes the next replication until there is none left,
+	// so the data are copied once for each thread instead of for each replication
+	std::atomic<int> next(0);
+	pool.parallelFor(numWorkers, [&](int) {
+		Simulation sim;
+		sim.init(loaded);
+		int r;
+		while ((r = next.fetch_add(1)) < numReplications) {
+			try {
+				if (r >= numWorkers)
+					sim.reset();	// the first one is reset by init()
+				sim.seed(seed, (unsigned long long)r);
+				if (setup)
+					setup(sim, r);
+				Report report;
+				do {
+					report = sim.run();
+				} while (!report.isFinished && sim.hasEvents());
+				results[r] = report;
+			}
+			catch (const char* msg) {
+				// an exception can't go across the threads, report it here
+				cout << "replication " << r << " error: " << msg << "\n";
+				results[r] = Report();
+				results[r].isFinished = false;
+			}
+		}
+	});
+
+	ReplicationReport summary;
+	summary.numReplications = int(results.size());
+	summary.numFinished = 0;
+	std::vector<double> travelTime, delay, departed, arrived;
+	for (auto iter = results.cbegin(); iter != results.cend(); iter++) {
+		if (!iter->isFinished)
+			continue;
+		summary.numFinished++;
+		travelTime.push_back(iter->totalTravelTime);
+		delay.push_back(iter->totalDelay);
+		departed.push_back(iter->numDeparted);
+		arrived.push_back(iter->numArrived);
+	}
+	summary.totalTravelTime = summarize(travelTime);
+	summary.totalDelay = summarize(delay);
+	summary.numDeparted = summarize(departed);
+	summary.numArrived = summarize(arrived);
+
+	if (reports != NULL)
+		reports->swap(results);
+	return summary;
+}
+
+void Statistic::show(const char* name, double scale) {
+	cout << name << mean * scale << " +- " << ci95 * scale << "\t(std " << stdDev * scale << ")\n";
+}
+
+void ReplicationReport::show() {
+	cout << "replications:\t\t\t" << numReplications << " (" << numFinished << " finished)\n";
+	totalTravelTime.show("totalTravelTime (h):\t\t", 1.0 / 3600.0);
+	totalDelay.show("totalDelay (h):\t\t\t", 1.0 / 3600.0);
+	numDeparted.show("# passenger departed:\t\t");
+	numArrived.show("# passenger arrived:\t\t");
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include "Simulation.hpp"
+#include <functional>
+
+// Run the same scenario many times with different random streams on all the cores, and
+// summarize the reports. Replication r uses the stream (seed, r) of CounterRNG, so the
+// results don't depend on the number of threads or the order the replications are run.
+
+// the mean, the standard deviation and the half width of the 95% confidence interval of the mean
+struct Statistic {
+	double mean;
+	double stdDev;
+	double ci95;
+	void show(const char* name, double scale = 1.0);
+};
+
+struct ReplicationReport {
+	int numReplications;
+	int numFinished;		// the replications that reach the end of the simulation
+	Statistic totalTravelTime;
+	Statistic totalDelay;
+	Statistic numDeparted;
+	Statistic numArrived;
+	void show();
+};
+
+// called for each replication after its reset, to add the suspends, incidents, ODs...
+typedef std::function<void(Simulation& sim, int replication)> ScenarioSetup;
+
+// run 'numReplications' replications sharing the data of 'loaded' with 'numThreads' threads
+// (0 for one per core). The report of each replication is written to 'reports' if not NULL.
+ReplicationReport runReplications(const Simulation& loaded, int numReplications, unsigned int seed, \
+	int numThreads = 0, const ScenarioSetup& setup = ScenarioSetup(), std::vector<Report>* reports = NULL);
@@ -0,0 +1,363 @@
+//Header Files
+#include "util.hpp"
+#include "Rerouting.hpp"
+#include <set>
+#include <unordered_map>
+
+#define DEFAULT_LINK_TIME 120.0		// the time of a link no train in the timetable runs on
+
+void RoutingGraph::build(const RouteTable& table, const std::vector<std::vector<int>>& startTrainInfo, \
+	const std::vector<std::vector<double>>& arrivalTime, const std::vector<std::vector<int>>& arrivalStationID) {
+	numStations = table.size();
+
+	// the mean running time between each two stations next to each other in the trips
+	std::unordered_map<long long, std::pair<double, int>> running;
+	for (auto iter = startTrainInfo.cbegin(); iter != startTrainInfo.cend(); iter++) {
+		int trainID = (*iter)[0];
+		int lastStation = (*iter)[1];
+		double lastTime = (*iter)[5];
+		for (size_t k = 0; k < arrivalTime[trainID].size(); k++) {
+			int station = arrivalStationID[trainID][k];
+			std::pair<double, int>& sum = running[(long long)lastStation * numStations + station];
+			sum.first += arrivalTime[trainID][k] - lastTime;
+			sum.second++;
+			lastStation = station;
+			lastTime = arrivalTime[trainID][k];
+		}
+	}
+
+	for (int set = 0; set < 2; set++) {
+		out[set].assign(numStations, std::vector<Link>());
+		in[set].assign(numStations, std::vector<Link>());
+		std::vector<char> added(numStations);
+		for (int from = 0; from < numStations; from++) {
+			std::fill(added.begin(), added.end(), 0);
+			for (int to = 0; to < numStations; to++) {
+				const RouteEntry& route = table.at(from, to);
+				for (int k = 0; k < route.policy_num; k++) {
+					int next = (set == 0) ? route.policy[k] : route.policy_offpeak[k];
+					if (next < 0 || next >= numStations || next == from || added[next])
+						continue;
+					added[next] = 1;
+
+					Link link = { next, DEFAULT_LINK_TIME };
+					if (table.at(from, next).transferTime != -1)
+						link.time = table.at(from, next).transferTime;
+					else {
+						auto sum = running.find((long long)from * numStations + next);
+						if (sum != running.end())
+							link.time = sum->second.first / sum->second.second;
+					}
+					out[set][from].push_back(link);
+					link.station = from;
+					in[set][next].push_back(link);
+				}
+			}
+		}
+	}
+}
+
+bool Simulation::isClosed(int from, int to) {
+	for (auto iter = closedStations.cbegin(); iter != closedStations.cend(); iter++) {
+		if (*iter == from || *iter == to)
+			return true;
+	}
+	for (auto iter = closedLinks.cbegin(); iter != closedLinks.cend(); iter++) {
+		if (iter->first == from && iter->second == to)
+			return true;
+	}
+	return false;
+}
+
+// Get the policies for the closed links and stations: starting from the loaded policies, for each
+// destination only the stations whose paths go through a closed element are routed again, on the
+// links left, from the stations whose paths are still open (the usual repair of a shortest path
+// tree). The stations with no other path keep their policies.
+// The work is kept to what the closures touch: for each destination, the stations going through
+// a closed element are found from there up the links of the graph, the time to the destination
+// of an open station is walked only when it is needed, and only the entries which differ (the
+// stations repaired now or before) are written, with their transfer closures, in the table as it
+// is (compressed or not). The table is changed in place if this simulator is its only user,
+// otherwise a copy is changed, so the other simulators and the snapshots sharing the old one are
+// not affected. A repaired station gets the new next station in all the policies of the set, so
+// policy_num and the other set are kept.
+// return the number of the (from, to, policy set) entries changed from the loaded policies
+int Simulation::updateRoutes() {
+	if (closedLinks.empty() && closedStations.empty()) {
+		if (loadedRoutes)
+			routes = loadedRoutes;
+		loadedRoutes.reset();
+		updateSlice();
+		return 0;
+	}
+	if (!loadedRoutes)
+		loadedRoutes = routes;
+	if (!routingGraph) {
+		routingGraph = std::make_shared<RoutingGraph>();
+		routingGraph->build(*loadedRoutes, startTrainInfo, arrivalTime, arrivalStationID);
+	}
+	const RoutingGraph& graph = *routingGraph;
+	const RouteTable& loaded = *loadedRoutes;
+
+	std::shared_ptr<RouteTable> table = routes;
+	if (routes == loadedRoutes || routes.use_count() > 1)
+		table = std::make_shared<RouteTable>(*routes);
+	if (table->repairs.empty())
+		table->repairs.resize(numStations);
+
+	// the stations which may go through a closed element: the first station of a closed link, a
+	// closed station and the stations with a link to it
+	std::vector<int> candidates[2];
+	for (int set = 0; set < 2; set++) {
+		for (auto iter = closedLinks.cbegin(); iter != closedLinks.cend(); iter++)
+			candidates[set].push_back(iter->first);
+		for (auto iter = closedStations.cbegin(); iter != closedStations.cend(); iter++) {
+			candidates[set].push_back(*iter);
+			const std::vector<RoutingGraph::Link>& links = graph.in[set][*iter];
+			for (auto iter_link = links.cbegin(); iter_link != links.cend(); iter_link++)
+				candidates[set].push_back(iter_link->station);
+		}
+	}
+
+	// the state of each station for the current destination and set, only the stations touched
+	// are set back to UNKNOWN
+	enum { UNKNOWN, OPEN, AFFECTED, VISITING };
+	std::vector<char> state(numStations, UNKNOWN);
+	std::vector<double> dist(numStations);
+	std::vector<int> next(numStations);
+	std::vector<int> touched;
+	std::vector<int> path;
+	std::vector<int> affected;
+	std::vector<int> repaired[2] = { std::vector<int>(numStations, -1), std::vector<int>(numStations, -1) };
+	std::vector<int> rows;
+	std::vector<RunCell<RouteEntry>> cells;
+
+	for (int to = 0; to < numStations; to++) {
+		rows.clear();
+		for (auto iter = table->repairs[to].cbegin(); iter != table->repairs[to].cend(); iter++)
+			rows.push_back(*iter / 2);
+
+		for (int set = 0; set < 2; set++) {
+			// the next station of the set by the loaded policies, -1 if there is no path
+			auto hopOf = [&loaded, set, to, this](int from) {
+				const RouteEntry& route = loaded.at(from, to);
+				int hop = (set == 0) ? route.policy[0] : route.policy_offpeak[0];
+				return (route.policy_num <= 0 || hop < 0 || hop >= numStations) ? -1 : hop;
+			};
+			auto linkTime = [&graph, set](int from, int to) {
+				const std::vector<RoutingGraph::Link>& links = graph.out[set][from];
+				for (auto iter = links.cbegin(); iter != links.cend(); iter++) {
+					if (iter->station == to)
+						return iter->time;
+				}
+				return DEFAULT_LINK_TIME;
+			};
+
+			// the stations with a closed policy, then the stations whose loaded path goes through them
+			affected.clear();
+			for (auto iter = candidates[set].cbegin(); iter != candidates[set].cend(); iter++) {
+				int from = *iter;
+				if (from == to || state[from] == AFFECTED || hopOf(from) < 0)
+					continue;
+				const RouteEntry& route = loaded.at(from, to);
+				bool closed = false;
+				for (int k = 0; k < route.policy_num && k < MAX_POLICY_NUM && !closed; k++)
+					closed = isClosed(from, (set == 0) ? route.policy[k] : route.policy_offpeak[k]);
+				if (closed) {
+					state[from] = AFFECTED;
+					touched.push_back(from);
+					affected.push_back(from);
+				}
+			}
+			if (affected.empty())
+				continue;
+			for (size_t i = 0; i < affected.size(); i++) {
+				const std::vector<RoutingGraph::Link>& links = graph.in[set][affected[i]];
+				for (auto iter = links.cbegin(); iter != links.cend(); iter++) {
+					int from = iter->station;
+					if (from != to && state[from] != AFFECTED && hopOf(from) == affected[i]) {
+						state[from] = AFFECTED;
+						touched.push_back(from);
+						affected.push_back(from);
+					}
+				}
+			}
+
+			// the time to the destination of an open station, following the loaded policies.
+			// -1 if there is no path (or a loop in the policies)
+			state[to] = OPEN;
+			dist[to] = 0.0;
+			touched.push_back(to);
+			auto distOf = [&](int start) {
+				int from = start;
+				path.clear();
+				while (state[from] == UNKNOWN) {
+					touched.push_back(from);
+					int hop = hopOf(from);
+					if (hop < 0) {
+						state[from] = OPEN;
+						dist[from] = -1.0;
+						break;
+					}
+					state[from] = VISITING;
+					path.push_back(from);
+					from = hop;
+				}
+				if (state[from] == VISITING) {
+					state[from] = OPEN;
+					dist[from] = -1.0;
+				}
+				for (auto iter = path.rbegin(); iter != path.rend(); iter++) {
+					int station = *iter;
+					int hop = hopOf(station);
+					state[station] = OPEN;
+					dist[station] = (dist[hop] < 0) ? -1.0 : dist[hop] + linkTime(station, hop);
+				}
+				return dist[start];
+			};
+
+			// Dijkstra over the affected stations, starting from the links to the open ones
+			typedef std::pair<double, int> Item;
+			std::priority_queue<Item, std::vector<Item>, std::greater<Item>> heap;
+			for (auto iter_affected = affected.cbegin(); iter_affected != affected.cend(); iter_affected++) {
+				int from = *iter_affected;
+				dist[from] = -1.0;
+				next[from] = -1;
+			}
+			for (auto iter_affected = affected.cbegin(); iter_affected != affected.cend(); iter_affected++) {
+				int from = *iter_affected;
+				const std::vector<RoutingGraph::Link>& links = graph.out[set][from];
+				for (auto iter = links.cbegin(); iter != links.cend(); iter++) {
+					int hop = iter->station;
+					if (state[hop] == AFFECTED || distOf(hop) < 0 || isClosed(from, hop))
+						continue;
+					double time = dist[hop] + iter->time;
+					if (dist[from] < 0 || time < dist[from]) {
+						dist[from] = time;
+						next[from] = hop;
+					}
+				}
+				if (next[from] >= 0)
+					heap.push(Item(dist[from], from));
+			}
+			while (!heap.empty()) {
+				Item item = heap.top();
+				heap.pop();
+				int station = item.second;
+				if (state[station] != AFFECTED || item.first > dist[station])
+					continue;
+				state[station] = OPEN;
+
+				// the affected stations before it may go through it
+				const std::vector<RoutingGraph::Link>& links = graph.in[set][station];
+				for (auto iter = links.cbegin(); iter != links.cend(); iter++) {
+					int from = iter->station;
+					if (state[from] != AFFECTED || isClosed(from, station))
+						continue;
+					double time = dist[station] + iter->time;
+					if (dist[from] < 0 || time < dist[from]) {
+						dist[from] = time;
+						next[from] = station;
+						heap.push(Item(time, from));
+					}
+				}
+			}
+
+			// the stations left affected have no other path
+			for (auto iter_affected = affected.cbegin(); iter_affected != affected.cend(); iter_affected++) {
+				int from = *iter_affected;
+				if (state[from] == OPEN && next[from] >= 0) {
+					repaired[set][from] = next[from];
+					rows.push_back(from);
+				}
+			}
+			for (auto iter = touched.cbegin(); iter != touched.cend(); iter++)
+				state[*iter] = UNKNOWN;
+			touched.clear();
+		}
+
+		// the entries of the rows repaired now or before: the loaded ones with the repairs of each set
+		std::sort(rows.begin(), rows.end());
+		rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+		table->repairs[to].clear();
+		for (auto iter = rows.cbegin(); iter != rows.cend(); iter++) {
+			int from = *iter;
+			RouteEntry route = loaded.at(from, to);
+			for (int set = 0; set < 2; set++) {
+				if (repaired[set][from] < 0)
+					continue;
+				int* policy = (set == 0) ? route.policy : route.policy_offpeak;
+				for (int k = 0; k < route.policy_num && k < MAX_POLICY_NUM; k++)
+					policy[k] = repaired[set][from];
+				table->repairs[to].push_back(from * 2 + set);
+				repaired[set][from] = -1;
+			}
+			if (!sameEntry(route, table->at(from, to))) {
+				RunCell<RouteEntry> cell = { from, to, route };
+				cells.push_back(cell);
+			}
+		}
+	}
+	table->setEntries(cells);
+
+	// the closures of the changed entries, and of the stations walking to them through a transfer
+	std::vector<std::pair<int, int>> walks;
+	std::set<std::pair<int, int>> added;
+	for (auto iter = cells.cbegin(); iter != cells.cend(); iter++) {
+		walks.push_back(std::make_pair(iter->row, iter->col));
+		added.insert(walks.back());
+	}
+	for (size_t i = 0; i < walks.size(); i++) {
+		int station = walks[i].first;
+		int to = walks[i].second;
+		for (int set = 0; set < 2; set++) {
+			const std::vector<RoutingGraph::Link>& links = graph.in[set][station];
+			for (auto iter = links.cbegin(); iter != links.cend(); iter++) {
+				int from = iter->station;
+				const RouteEntry& route = table->at(from, to);
+				if (route.policy_num == 1 && ((set == 0) ? route.policy[0] : route.policy_offpeak[0]) == station && \
+					table->at(from, station).transferTime != -1 && added.insert(std::make_pair(from, to)).second)
+					walks.push_back(std::make_pair(from, to));
+			}
+		}
+	}
+	table->buildClosure(walks);
+	routes = table;
+	updateSlice();
+
+	int numChanged = 0;
+	for (int to = 0; to < numStations; to++)
+		numChanged += int(table->repairs[to].size());
+	return numChanged;
+}
+
+int Simulation::closeLink(int from, int to) {
+	if (from < 0 || from >= numStations || to < 0 || to >= numStations) {
+		cout << "link from " << from << " to " << to << " not existing!\n";
+		throw "Invalid link!";
+	}
+	// kept even if a station of it is closed, so it stays closed when the station is reopened
+	if (std::find(closedLinks.begin(), closedLinks.end(), std::make_pair(from, to)) == closedLinks.end())
+		closedLinks.push_back(std::make_pair(from, to));
+	return updateRoutes();
+}
+
+int Simulation::reopenLink(int from, int to) {
+	closedLinks.erase(std::remove(closedLinks.begin(), closedLinks.end(), std::make_pair(from, to)), closedLinks.end());
+	return updateRoutes();
+}
+
+int Simulation::closeStation(int station) {
+	if (station < 0 || station >= numStations) {
+		cout << "station " << station << " not existing!\n";
+		throw "Invalid station!";
+	}
+	if (std::find(closedStations.begin(), closedStations.end(), station) == closedStations.end())
+		closedStations.push_back(station);
+	return updateRoutes();
+}
+
+int Simulation::reopenStation(int station) {
+	closedStations.erase(std::remove(closedStations.begin(), closedStations.end(), station), closedStations.end());
+	return updateRoutes();
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "Simulation.hpp"
+
+// The network the policies are the shortest paths on, used to repair the policies when a link
+// or a station is closed (see Simulation::closeLink()). A link i -> j of a policy set is there
+// if j is the next station from i to somewhere in that set, so the off-peak set doesn't get the
+// links it never uses. The time of a link is the transfer time, or the mean time between the
+// arrivals at i and j of the trains in the timetable.
+struct RoutingGraph {
+	struct Link {
+		int station;	// the other end of the link
+		double time;
+	};
+	int numStations;
+	std::vector<std::vector<Link>> out[2];	// [policy set][i], the links leaving i (peak, off-peak)
+	std::vector<std::vector<Link>> in[2];	// [policy set][j], the links arriving at j
+
+	void build(const RouteTable& table, const std::vector<std::vector<int>>& startTrainInfo, \
+		const std::vector<std::vector<double>>& arrivalTime, const std::vector<std::vector<int>>& arrivalStationID);
+};
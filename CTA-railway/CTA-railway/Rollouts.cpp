@@ -0,0 +1,79 @@
+//Header Files
+#include "util.hpp"
+#include "Rollouts.hpp"
+#include <atomic>
+
+RolloutEvaluator::RolloutEvaluator(int numThreads) : pool(numThreads), source(NULL) {}
+
+RolloutEvaluator::~RolloutEvaluator() {
+	for (auto iter = sims.begin(); iter != sims.end(); iter++)
+		delete *iter;
+}
+
+int RolloutEvaluator::evaluateCandidates(const Simulation& live, const std::vector<CandidateAction>& actions, \
+	double horizon, std::vector<Report>& deltas) {
+	int numCandidates = int(actions.size());
+	deltas.assign(numCandidates, Report());
+	if (numCandidates == 0)
+		return 0;
+
+	int numWorkers = pool.size() < numCandidates ? pool.size() : numCandidates;
+	if (source != &live) {
+		for (auto iter = sims.begin(); iter != sims.end(); iter++)
+			delete *iter;
+		sims.clear();
+		source = &live;
+	}
+	while (int(sims.size()) < numWorkers) {
+		Simulation* sim = new Simulation;
+		sim->init(live);
+		sims.push_back(sim);
+	}
+
+	double endTime = live.time + horizon;
+	std::vector<char> reached(numCandidates, 0);
+
+	// each thread takes the next candidate until there is none left, like the replications
+	std::atomic<int> next(0);
+	pool.parallelFor(numWorkers, [&](int w) {
+		Simulation& sim = *sims[w];
+		int k;
+		while ((k = next.fetch_add(1)) < numCandidates) {
+			const CandidateAction& action = actions[k];
+			Report& delta = deltas[k];
+			try {
+				if (action.from.size() != action.time.size() || action.to.size() != action.time.size() || \
+					action.num.size() != action.time.size())
+					throw "The arrays of the candidate are not of the same length!";
+				sim.cloneState(live);
+				sim.addODBatch(action.time.data(), action.from.data(), action.to.data(), action.num.data(), action.time.size());
+				sim.addEvent(Event(endTime, SUSPEND));
+
+				// the suspend points of 'live' before the horizon are passed through
+				Report report;
+				do {
+					report = sim.run();
+				} while (!report.isFinished && sim.getTime() < endTime && sim.hasEvents());
+
+				delta.isFinished = report.isFinished;
+				delta.totalTravelTime = report.totalTravelTime - live.totalTravelTime;
+				delta.totalDelay = report.totalDelay - live.totalDelay;
+				delta.numDeparted = report.numDeparted - live.num_departed;
+				delta.numArrived = report.numArrived - live.num_arrived;
+				delta.stats = NULL;		// the copy is used by the next candidate
+				reached[k] = 1;
+			}
+			catch (const char* msg) {
+				// an exception can't go across the threads, report it here
+				cout << "candidate " << k << " error: " << msg << "\n";
+				delta = Report();
+				delta.isFinished = false;
+			}
+		}
+	});
+
+	int numReached = 0;
+	for (int k = 0; k < numCandidates; k++)
+		numReached += reached[k];
+	return numReached;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "Simulation.hpp"
+#include "ThreadPool.hpp"
+
+// What-if rollouts for choosing a control action, e.g. the let-in proportion of the gated
+// stations: each candidate is run forward from the state of the live simulator on a copy of
+// it, so the live one is not changed and nothing is run again from 0:00. The candidates
+// are run at the same time on the threads of the evaluator. All the copies take the random
+// engine of the live simulator, so the candidates are compared with the same random choices.
+
+// the passengers a candidate action lets in, added to the copy before it runs (see addODBatch)
+struct CandidateAction {
+	std::vector<double> time;
+	std::vector<int> from;
+	std::vector<int> to;
+	std::vector<int> num;
+};
+
+class RolloutEvaluator {
+public:
+	RolloutEvaluator(int numThreads = 0);	// 0 means one thread per core
+	~RolloutEvaluator();
+	RolloutEvaluator(const RolloutEvaluator&) = delete;
+	RolloutEvaluator& operator=(const RolloutEvaluator&) = delete;
+
+	// run each candidate from the state of 'live' for 'horizon' sec (or to the end of the day).
+	// deltas[k] gets what candidate k adds to the report of 'live' (totalTravelTime, totalDelay,
+	// numDeparted and numArrived), and isFinished if it reaches the end of the day.
+	// return the number of candidates run to the horizon, the others failed and get a zero delta
+	int evaluateCandidates(const Simulation& live, const std::vector<CandidateAction>& actions, double horizon, \
+		std::vector<Report>& deltas);
+
+private:
+	ThreadPool pool;
+	std::vector<Simulation*> sims;	// one for each thread, kept between the calls so that the data
+									// are copied once. made again for another live simulator
+	const Simulation* source;		// the simulator 'sims' share the data with
+};
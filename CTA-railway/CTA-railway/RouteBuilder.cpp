@@ -0,0 +1,180 @@
+//Header Files
+#include "util.hpp"
+#include "Simulation.hpp"
+#include "RouteBuilder.hpp"
+#include "DataCache.hpp"
+#include "ThreadPool.hpp"
+#include <chrono>
+#include <stdio.h>
+
+#define TIE_TOLERANCE 1e-6		// paths within this many seconds are the same length
+
+struct BuilderLink {
+	int to;
+	double time;
+};
+
+// the next stations of the shortest paths from one station to each station
+struct NextStations {
+	int num;
+	int station[MAX_POLICY_NUM];
+};
+
+// read the links into lists by the starting station, the header and the links with a negative
+// time (no link) are skipped. return the largest station ID
+static int readLinks(const std::string& file_name, std::vector<std::vector<BuilderLink>>& links) {
+	int maxID = -1;
+	readcsv(file_name, [&links, &maxID](const CsvField* fields, int n) {
+		if (n < 3 || !((*fields[0].begin >= '0' && *fields[0].begin <= '9') || *fields[0].begin == '.'))
+			return;
+		int from = fields[0].toInt();
+		int to = fields[1].toInt();
+		double time = fields[2].toDouble();
+		if (from < 0 || to < 0 || time < 0 || from == to)
+			return;
+		if (from >= int(links.size()))
+			links.resize(from + 1);
+		BuilderLink link = { to, time };
+		links[from].push_back(link);
+		maxID = std::max(maxID, std::max(from, to));
+	});
+	return maxID;
+}
+
+// add the next stations of 'from' to those of 'to', in order and without repeat
+static void mergeNext(NextStations& to, const NextStations& from) {
+	for (int i = 0; i < from.num; i++) {
+		int station = from.station[i];
+		int k = 0;
+		while (k < to.num && to.station[k] < station)
+			k++;
+		if ((k < to.num && to.station[k] == station) || k >= MAX_POLICY_NUM)
+			continue;
+		int last = std::min(to.num, MAX_POLICY_NUM - 1);
+		for (int j = last; j > k; j--)
+			to.station[j] = to.station[j - 1];
+		to.station[k] = station;
+		if (to.num < MAX_POLICY_NUM)
+			to.num++;
+	}
+}
+
+// Dijkstra from 'source', the next stations of all the paths of the same shortest length are
+// collected: a station gets those of each station it is reached from at that length
+static void shortestPaths(int source, const std::vector<std::vector<BuilderLink>>& links, std::vector<double>& dist, \
+	std::vector<NextStations>& next) {
+	int N = int(dist.size());
+	std::fill(dist.begin(), dist.end(), -1.0);
+	for (int i = 0; i < N; i++)
+		next[i].num = 0;
+
+	typedef std::pair<double, int> Item;
+	std::priority_queue<Item, std::vector<Item>, std::greater<Item>> heap;
+	std::vector<char> done(N, 0);
+	dist[source] = 0.0;
+	heap.push(Item(0.0, source));
+	while (!heap.empty()) {
+		Item item = heap.top();
+		heap.pop();
+		int from = item.second;
+		if (done[from] || item.first > dist[from])
+			continue;
+		done[from] = 1;
+		if (from >= int(links.size()))
+			continue;
+		for (auto iter = links[from].cbegin(); iter != links[from].cend(); iter++) {
+			int to = iter->to;
+			if (to >= N || done[to])
+				continue;
+			NextStations first = { 1, { to } };
+			const NextStations& via = (from == source) ? first : next[from];
+			double time = dist[from] + iter->time;
+			if (dist[to] < 0 || time < dist[to] - TIE_TOLERANCE) {
+				dist[to] = time;
+				next[to] = via;
+				heap.push(Item(time, to));
+			}
+			else if (time <= dist[to] + TIE_TOLERANCE)
+				mergeNext(next[to], via);
+		}
+	}
+}
+
+// the tables of all the stations, next[from * N + to]
+static void allPairs(const std::vector<std::vector<BuilderLink>>& links, int N, ThreadPool& pool, \
+	std::vector<NextStations>& next) {
+	next.resize(size_t(N) * N);
+	pool.parallelFor(N, [&links, N, &next](int from) {
+		std::vector<double> dist(N);
+		std::vector<NextStations> row(N);
+		shortestPaths(from, links, dist, row);
+		std::copy(row.begin(), row.end(), next.begin() + size_t(from) * N);
+	});
+}
+
+static bool writePolicy(const std::string& file_name, const std::vector<NextStations>& next, \
+	const std::vector<NextStations>& counts, int N) {
+	FILE* file = fopen(file_name.c_str(), "w");
+	if (file == NULL)
+		return false;
+	for (int from = 0; from < N; from++) {
+		for (int to = 0; to < N; to++) {
+			const NextStations& hops = next[size_t(from) * N + to];
+			int num = counts[size_t(from) * N + to].num;
+			if (from == to || num == 0 || hops.num == 0)
+				continue;
+			// the same number of policies as the peak ones, policy_num is shared by both sets
+			fprintf(file, "%d,%d", from, to);
+			for (int k = 0; k < num; k++)
+				fprintf(file, ",%d", hops.station[k % hops.num]);
+			fprintf(file, "\n");
+		}
+	}
+	return fclose(file) == 0;
+}
+
+bool buildRoutes(const std::string& linkFile, const std::string& offpeakLinkFile, const std::string& outDir, \
+	int numThreads) {
+	auto start = std::chrono::steady_clock::now();
+	std::vector<std::vector<BuilderLink>> peakLinks, offpeakLinks;
+	int maxID = readLinks(linkFile, peakLinks);
+	if (!offpeakLinkFile.empty())
+		maxID = std::max(maxID, readLinks(offpeakLinkFile, offpeakLinks));
+
+	// the tables must cover all the stations of the data set
+	int N = 0;
+	std::string stationFile = outDir + "/stations.csv";
+	long long size, mtime;
+	if (getFileStamp(stationFile.c_str(), size, mtime))
+		readcsv(stationFile, [&N](const CsvField*, int) { N++; });
+	if (N <= maxID) {
+		if (N > 0)
+			cout << "the links have station " << maxID << ", more than in " << stationFile << "\n";
+		N = maxID + 1;
+	}
+
+	ThreadPool pool(numThreads);
+	std::vector<NextStations> peak, offpeak;
+	allPairs(peakLinks, N, pool, peak);
+	if (!offpeakLinkFile.empty())
+		allPairs(offpeakLinks, N, pool, offpeak);
+	const std::vector<NextStations>& offpeakNext = offpeakLinkFile.empty() ? peak : offpeak;
+
+	bool ok = writePolicy(outDir + "/policy.csv", peak, peak, N) && \
+		writePolicy(outDir + "/policy2.csv", offpeakNext, peak, N);
+	FILE* file = fopen((outDir + "/policy_num.csv").c_str(), "w");
+	ok = ok && file != NULL;
+	for (int from = 0; ok && from < N; from++) {
+		for (int to = 0; to < N; to++)
+			fprintf(file, (to + 1 < N) ? "%d," : "%d\n", (from == to) ? 0 : peak[size_t(from) * N + to].num);
+	}
+	if (file != NULL)
+		ok = (fclose(file) == 0) && ok;
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if (ok)
+		cout << "routes of " << N << " stations built in " << seconds << " s with " << pool.size() << " threads\n";
+	else
+		cout << "can't write the routes into " << outDir << "\n";
+	return ok;
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include <string>
+
+// Build the routing tables the simulator loads (policy.csv, policy2.csv and policy_num.csv) from
+// the links of the network, instead of the python preprocessing. The link files are in the
+// format of intermediate_data/rail_link.csv: [from, to, time] with a header, the running links
+// and the transfer links together. The policies are the next stations of all the shortest paths
+// (up to MAX_POLICY_NUM of them when there are ties), one Dijkstra for each station on all the
+// cores. 'offpeakLinkFile' gives the links of the off-peak policies, the peak links are used
+// if it is empty. The number of stations is the number of rows of 'outDir'/stations.csv, or
+// the largest station ID in the links + 1 if there is no such file.
+// return false if the tables can't be written
+bool buildRoutes(const std::string& linkFile, const std::string& offpeakLinkFile, const std::string& outDir, \
+	int numThreads = 0);
@@ -0,0 +1,84 @@
+//Header Files
+#include "util.hpp"
+#include "RoutingIndex.hpp"
+#include "DataCache.hpp"
+#include <cmath>
+#include <limits>
+
+RoutingIndex::RoutingIndex(const std::string& dataDir) : dataDir(dataDir) {
+	string file_name = dataDir + "/" + PERIODS_FILE;
+	long long size, mtime;
+	if (!getFileStamp(file_name.c_str(), size, mtime)) {
+		// the peak hours, a slice starting right after the last second of the peak
+		double inf = std::numeric_limits<double>::infinity();
+		TimeSlice defaults[5] = { { 0.0, 1 }, { 19080.0, 0 }, { std::nextafter(33900.0, inf), 1 }, \
+			{ 51900.0, 0 }, { std::nextafter(66600.0, inf), 1 } };
+		slices.assign(defaults, defaults + 5);
+		return;
+	}
+
+	readcsv(file_name, [this](const CsvField* fields, int n) {
+		if (n < 2)
+			throw "A row of periods.csv must be [start time, policy set]!";
+		TimeSlice slice = { fields[0].toDouble(), fields[1].toInt() };
+		slices.push_back(slice);
+	});
+	if (slices.empty())
+		throw "No time slice in periods.csv!";
+	for (size_t i = 0; i < slices.size(); i++) {
+		if (i > 0 && slices[i].start <= slices[i - 1].start) {
+			cout << "time slice " << i << " at " << slices[i].start << " in " << file_name << "\n";
+			throw "The time slices must be in the order of time!";
+		}
+		int set = slices[i].policySet;
+		string policy_name = dataDir + "/policy" + std::to_string(set + 1) + ".csv";
+		if (set < 0 || (set >= 2 && !getFileStamp(policy_name.c_str(), size, mtime))) {
+			cout << "policy set " << set << " of time slice " << i << " not existing!\n";
+			throw "Invalid policy set in periods.csv!";
+		}
+	}
+}
+
+int RoutingIndex::find(double time) const {
+	auto iter = std::upper_bound(slices.begin(), slices.end(), time, [](double t, const TimeSlice& slice) {
+		return t < slice.start;
+	});
+	return (iter == slices.begin()) ? 0 : int(iter - slices.begin()) - 1;
+}
+
+double RoutingIndex::sliceEnd(int i) const {
+	if (i + 1 < int(slices.size()))
+		return slices[i + 1].start;
+	return std::numeric_limits<double>::infinity();
+}
+
+const RouteTable* RoutingIndex::policySet(int set, const RouteTable& base) {
+	std::lock_guard<std::mutex> lock(mtx);
+	if (int(sets.size()) <= set)
+		sets.resize(set + 1);
+	if (sets[set])
+		return sets[set].get();
+
+	// the policies of the set in the 'policy' fields of a copy, the rest is the same.
+	// the entries are changed all at once, so a compressed table is never expanded
+	std::shared_ptr<RouteTable> table = std::make_shared<RouteTable>(base);
+	int N = table->size();
+	std::vector<RunCell<RouteEntry>> cells;
+	string file_name = dataDir + "/policy" + std::to_string(set + 1) + ".csv";
+	readcsv(file_name, [&table, &cells, N, &file_name](const CsvField* fields, int n) {
+		int from = fields[0].toInt();
+		int to = fields[1].toInt();
+		if (from < 0 || from >= N || to < 0 || to >= N) {
+			cout << "illegal OD pair from " << from << " to " << to << " in " << file_name << "!\n";
+			throw "Station ID out of range!";
+		}
+		RunCell<RouteEntry> cell = { from, to, table->at(from, to) };
+		for (int index = 0; index < n - 2 && index < MAX_POLICY_NUM; index++)
+			cell.value.policy[index] = fields[index + 2].toInt();
+		cells.push_back(cell);
+	});
+	table->setEntries(cells);
+	table->buildClosure();
+	sets[set] = table;
+	return table.get();
+}
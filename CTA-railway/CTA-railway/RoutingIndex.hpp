@@ -0,0 +1,43 @@
+#pragma once
+#include "Simulation.hpp"
+#include <mutex>
+
+// The policy set used at each time of the day. The day is cut into time slices by periods.csv,
+// [start time (sec), policy set] in the order of time, and a slice lasts until the next one starts
+// (the times before the first slice belong to it). Set 0 is policy.csv and set 1 is policy2.csv,
+// the peak and off-peak fields of the route table. Set k >= 2 is policy<k + 1>.csv (e.g.
+// policy3.csv), in the same format as policy2.csv, with the policy_num, directions and transfer
+// times of the route table. The slices of the same set share it, and a set k >= 2 is only loaded
+// when a simulator first gets into one of its slices.
+// Without periods.csv the slices are the peak hours 19080-33900 and 51900-66600 (both ends in
+// the peak) and the off-peak hours around them.
+// The simulator keeps the slice of its time (see Simulation::updateSlice()), so a query doesn't
+// look at the time. Closing links and stations (see Simulation::closeLink()) repairs sets 0 and 1 only.
+#define PERIODS_FILE "periods.csv"
+
+struct TimeSlice {
+	double start;		// from this time on, until the next slice
+	int policySet;
+};
+
+class RoutingIndex {
+public:
+	RoutingIndex(const std::string& dataDir);	// read the slices, check the policy files exist
+	RoutingIndex(const RoutingIndex&) = delete;
+	RoutingIndex& operator=(const RoutingIndex&) = delete;
+
+	int find(double time) const;	// the slice of the time
+	const TimeSlice& slice(int i) const { return slices[i]; }
+	double sliceEnd(int i) const;	// the start of the next slice, infinity for the last one
+	int numSlices() const { return int(slices.size()); }
+
+	// the route table of a policy set k >= 2 (its 'policy' fields), made from the loaded route
+	// table 'base' the first time, then shared by all the simulators
+	const RouteTable* policySet(int set, const RouteTable& base);
+
+private:
+	std::string dataDir;
+	std::vector<TimeSlice> slices;
+	std::vector<std::shared_ptr<RouteTable>> sets;	// [set], NULL until loaded, sets 0 and 1 are never
+	std::mutex mtx;									// loaded here
+};
@@ -0,0 +1,229 @@
+//Header Files
+#include "Scheduler.hpp"
+#include <math.h>
+
+EventScheduler* EventScheduler::create(SchedulerType type, bool byKey) {
+	switch (type) {
+	case QUATERNARY_HEAP:
+		return new QuaternaryHeapScheduler(byKey);
+	case CALENDAR_QUEUE:
+		return new CalendarScheduler(byKey);
+	default:
+		return new BinaryHeapScheduler(byKey);
+	}
+}
+
+// in the order given, a scheduler can insert them faster if it gives the same order
+void EventScheduler::pushBatch(const std::vector<Event>& events) {
+	for (auto iter = events.cbegin(); iter != events.cend(); iter++)
+		push(*iter);
+}
+
+// a big batch (compared to the heap) is appended and the heap is built again in O(n),
+// a small one is pushed one by one in O(k log n). No two records have the same (time, seq), nor
+// in key order the same (time, key), so the rebuilt heap pops them in the same order as the
+// pushes would. The binary heap not in key order leaves the events at the same time to its
+// layout, so it is always pushed one by one
+#define BATCH_REBUILD_RATIO 8
+
+// ---------------- binary heap ----------------
+
+Event BinaryHeapScheduler::pop() {
+	Event nextevent = heap.top();
+	heap.pop();
+	return nextevent;
+}
+
+void BinaryHeapScheduler::pushBatch(const std::vector<Event>& events) {
+	std::vector<Event>& all = heap.container();
+	if (!byKey || events.size() * BATCH_REBUILD_RATIO < all.size()) {
+		EventScheduler::pushBatch(events);
+		return;
+	}
+	all.insert(all.end(), events.begin(), events.end());
+	std::make_heap(all.begin(), all.end(), heap.compare());
+	STATS(noteSize(all.size()));
+}
+
+void BinaryHeapScheduler::forEach(const std::function<void(Event&)>& visit) {
+	std::vector<Event>& events = heap.container();
+	for (auto iter = events.begin(); iter != events.end(); iter++)
+		visit(*iter);
+}
+
+// ---------------- slab ----------------
+
+uint32_t EventSlab::add(const Event& newevent) {
+	if (!freeSlots.empty()) {
+		uint32_t slot = freeSlots.back();
+		freeSlots.pop_back();
+		events[slot] = newevent;
+		return slot;
+	}
+	events.push_back(newevent);
+	return uint32_t(events.size() - 1);
+}
+
+Event EventSlab::remove(uint32_t slot) {
+	freeSlots.push_back(slot);
+	return events[slot];
+}
+
+// the std heap functions build a max-heap, so compare the other way round
+struct RecordLater {
+	RecordBefore before;
+
+	bool operator()(const EventRecord& left, const EventRecord& right) const {
+		return before(right, left);
+	}
+};
+
+// ---------------- 4-ary heap ----------------
+
+void QuaternaryHeapScheduler::push(const Event& newevent) {
+	EventRecord record = { newevent.time, nextSeq++, slab.add(newevent) };
+	RecordBefore before = order();
+
+	// sift up
+	size_t i = heap.size();
+	heap.push_back(record);
+	while (i > 0) {
+		size_t parent = (i - 1) / 4;
+		if (!before(record, heap[parent]))
+			break;
+		heap[i] = heap[parent];
+		i = parent;
+	}
+	heap[i] = record;
+	STATS(noteSize(heap.size()));
+}
+
+void QuaternaryHeapScheduler::pushBatch(const std::vector<Event>& events) {
+	if (events.size() * BATCH_REBUILD_RATIO < heap.size()) {
+		EventScheduler::pushBatch(events);
+		return;
+	}
+	for (auto iter = events.cbegin(); iter != events.cend(); iter++) {
+		EventRecord record = { iter->time, nextSeq++, slab.add(*iter) };
+		heap.push_back(record);
+	}
+
+	// build the heap from the last parent up to the root
+	if (heap.size() > 1) {
+		for (size_t i = (heap.size() - 2) / 4 + 1; i > 0; i--)
+			siftDown(i - 1, heap[i - 1]);
+	}
+	STATS(noteSize(heap.size()));
+}
+
+void QuaternaryHeapScheduler::siftDown(size_t i, EventRecord record) {
+	RecordBefore before = order();
+	size_t n = heap.size();
+	while (true) {
+		size_t first = i * 4 + 1;
+		if (first >= n)
+			break;
+		size_t end = (first + 4 < n) ? first + 4 : n;
+		size_t smallest = first;
+		for (size_t child = first + 1; child < end; child++) {
+			if (before(heap[child], heap[smallest]))
+				smallest = child;
+		}
+		if (!before(heap[smallest], record))
+			break;
+		heap[i] = heap[smallest];
+		i = smallest;
+	}
+	heap[i] = record;
+}
+
+Event QuaternaryHeapScheduler::pop() {
+	uint32_t slot = heap[0].slot;
+	EventRecord last = heap.back();
+	heap.pop_back();
+
+	// sift down the last record from the root
+	if (!heap.empty())
+		siftDown(0, last);
+	return slab.remove(slot);
+}
+
+void QuaternaryHeapScheduler::forEach(const std::function<void(Event&)>& visit) {
+	for (auto iter = heap.begin(); iter != heap.end(); iter++)
+		visit(slab.at(iter->slot));
+}
+
+// ---------------- calendar queue ----------------
+
+CalendarScheduler::CalendarScheduler(bool byKey) : EventScheduler(CALENDAR_QUEUE, byKey), cursor(0), count(0) {
+	buckets.resize(size_t(ceil(86400.0 * CALENDAR_DAYS / BUCKET_WIDTH)));
+}
+
+void CalendarScheduler::push(const Event& newevent) {
+	EventRecord record = { newevent.time, nextSeq++, slab.add(newevent) };
+	count++;
+	STATS(noteSize(count));
+
+	double horizon = BUCKET_WIDTH * buckets.size();
+	if (newevent.time >= horizon) {
+		overflow.push_back(record);
+		std::push_heap(overflow.begin(), overflow.end(), RecordLater{ order() });
+		return;
+	}
+
+	// an event before the current bucket (e.g. an OD added late by the user) is served next
+	size_t bucket = (newevent.time > 0) ? size_t(newevent.time / BUCKET_WIDTH) : 0;
+	if (bucket <= cursor) {
+		buckets[cursor].push_back(record);
+		std::push_heap(buckets[cursor].begin(), buckets[cursor].end(), RecordLater{ order() });
+	}
+	else {
+		buckets[bucket].push_back(record);
+	}
+}
+
+void CalendarScheduler::advance() {
+	while (buckets[cursor].empty() && cursor + 1 < buckets.size())
+		cursor++;
+	std::make_heap(buckets[cursor].begin(), buckets[cursor].end(), RecordLater{ order() });
+}
+
+Event CalendarScheduler::pop() {
+	if (buckets[cursor].empty())
+		advance();
+
+	// all the buckets are empty, take from the events after the last bucket
+	std::vector<EventRecord>& from = buckets[cursor].empty() ? overflow : buckets[cursor];
+	std::pop_heap(from.begin(), from.end(), RecordLater{ order() });
+	uint32_t slot = from.back().slot;
+	from.pop_back();
+	count--;
+	return slab.remove(slot);
+}
+
+double CalendarScheduler::nextTime() {
+	if (buckets[cursor].empty())
+		advance();
+	const std::vector<EventRecord>& from = buckets[cursor].empty() ? overflow : buckets[cursor];
+	return from.front().time;
+}
+
+void CalendarScheduler::clear() {
+	for (auto iter = buckets.begin(); iter != buckets.end(); iter++)
+		iter->clear();
+	overflow.clear();
+	slab.clear();
+	cursor = 0;
+	count = 0;
+	nextSeq = 0;
+	highWater = 0;
+}
+
+void CalendarScheduler::forEach(const std::function<void(Event&)>& visit) {
+	for (auto iter = buckets.begin(); iter != buckets.end(); iter++) {
+		for (auto record = iter->begin(); record != iter->end(); record++)
+			visit(slab.at(record->slot));
+	}
+	for (auto record = overflow.begin(); record != overflow.end(); record++)
+		visit(slab.at(record->slot));
+}
@@ -0,0 +1,139 @@
+#pragma once
+#include "Simulation.hpp"
+#include <functional>
+#include <stdint.h>
+
+// The queue of the future events used by Simulation::run(). Several implementations can be
+// chosen with Simulation::setScheduler() (or DEFAULT_SCHEDULER at compile time) to compare them:
+//	BINARY_HEAP		std::priority_queue of the whole Event, the original one. The order of events
+//					at the same time is left to the heap.
+//	QUATERNARY_HEAP	4-ary heap of 16-byte records, the events stay in a slab and are not moved.
+//	CALENDAR_QUEUE	one bucket per BUCKET_WIDTH seconds of the day, only the current bucket is
+//					kept in order.
+// The last two serve the events at the same time in the order they are added, so their results
+// can differ a little from the binary heap when several events happen at the same second. In key
+// order ('byKey', see eventBefore()) all of them serve the events by (time, key) and give the
+// same results.
+class EventScheduler {
+public:
+	EventScheduler(SchedulerType type, bool byKey) : highWater(0), type(type), byKey(byKey), nextSeq(0) {}
+	virtual ~EventScheduler() {}
+	virtual void push(const Event& newevent) = 0;
+	virtual void pushBatch(const std::vector<Event>& events);	// add many events at once, as if pushed one by one
+	virtual Event pop() = 0;			// remove and return the earliest event, the queue must not be empty
+	virtual double nextTime() = 0;		// the time of the earliest event, the queue must not be empty
+	virtual bool empty() const = 0;
+	virtual size_t size() const = 0;
+	virtual void clear() = 0;
+	virtual EventScheduler* clone() const = 0;	// a copy of the queue, used by the snapshots
+	virtual void forEach(const std::function<void(Event&)>& visit) = 0;	// visit all events, in no order
+
+	static EventScheduler* create(SchedulerType type, bool byKey = false);
+
+	size_t highWater;	// the most events in the queue since clear(), kept only with SIM_STATS
+	const SchedulerType type;
+	const bool byKey;	// serve the events at the same time by their keys
+
+protected:
+	uint32_t nextSeq;		// the order the events are added, for the records
+
+	void noteSize(size_t n) { if (n > highWater) highWater = n; }
+};
+
+class BinaryHeapScheduler : public EventScheduler {
+public:
+	BinaryHeapScheduler(bool byKey) : EventScheduler(BINARY_HEAP, byKey), heap(byKey) {}
+	void push(const Event& newevent) { heap.push(newevent); STATS(noteSize(heap.size())); }
+	void pushBatch(const std::vector<Event>& events);
+	Event pop();
+	double nextTime() { return heap.top().time; }
+	bool empty() const { return heap.empty(); }
+	size_t size() const { return heap.size(); }
+	void clear() { heap.clear(); highWater = 0; }
+	EventScheduler* clone() const { return new BinaryHeapScheduler(*this); }
+	void forEach(const std::function<void(Event&)>& visit);
+
+private:
+	EventHeap heap;
+};
+
+// the events themselves, kept in place while the schedulers move the small records around
+class EventSlab {
+public:
+	uint32_t add(const Event& newevent);	// return the slot of the event
+	Event remove(uint32_t slot);
+	Event& at(uint32_t slot) { return events[slot]; }
+	unsigned long long keyAt(uint32_t slot) const { return events[slot].key; }
+	void clear() { events.clear(); freeSlots.clear(); }
+
+private:
+	std::vector<Event> events;
+	std::vector<uint32_t> freeSlots;
+};
+
+// 16 bytes for each event in the queue. The 64-bit key of the event doesn't fit, so the events at
+// the same time are ordered by 'seq' (the order they are added, less than 2^32 events between two
+// clear()), or in key order by the keys of their events in the slab, looked up only for such ties
+struct EventRecord {
+	double time;
+	uint32_t seq;		// the order the events are added, to serve the events at the same time in order
+	uint32_t slot;		// where the event is in the slab
+};
+
+struct RecordBefore {
+	const EventSlab* slab;
+	bool byKey;
+
+	bool operator()(const EventRecord& left, const EventRecord& right) const {
+		if (left.time != right.time)
+			return left.time < right.time;
+		return byKey ? slab->keyAt(left.slot) < slab->keyAt(right.slot) : left.seq < right.seq;
+	}
+};
+
+class QuaternaryHeapScheduler : public EventScheduler {
+public:
+	QuaternaryHeapScheduler(bool byKey) : EventScheduler(QUATERNARY_HEAP, byKey) {}
+	void push(const Event& newevent);
+	void pushBatch(const std::vector<Event>& events);
+	Event pop();
+	double nextTime() { return heap[0].time; }
+	bool empty() const { return heap.empty(); }
+	size_t size() const { return heap.size(); }
+	void clear() { heap.clear(); slab.clear(); nextSeq = 0; highWater = 0; }
+	EventScheduler* clone() const { return new QuaternaryHeapScheduler(*this); }
+	void forEach(const std::function<void(Event&)>& visit);
+
+private:
+	std::vector<EventRecord> heap;
+	EventSlab slab;
+
+	RecordBefore order() const { return RecordBefore{ &slab, byKey }; }	// made when used, a copy has its own slab
+	void siftDown(size_t i, EventRecord record);	// put the record at i or below
+};
+
+#define BUCKET_WIDTH 16.0		// seconds of each bucket of the calendar queue
+#define CALENDAR_DAYS 2			// the buckets cover this many days, the later events wait in 'overflow'
+
+class CalendarScheduler : public EventScheduler {
+public:
+	CalendarScheduler(bool byKey);
+	void push(const Event& newevent);	// O(1) already, the batches are pushed one by one
+	Event pop();
+	double nextTime();
+	bool empty() const { return count == 0; }
+	size_t size() const { return count; }
+	void clear();
+	EventScheduler* clone() const { return new CalendarScheduler(*this); }
+	void forEach(const std::function<void(Event&)>& visit);
+
+private:
+	std::vector<std::vector<EventRecord>> buckets;
+	std::vector<EventRecord> overflow;	// a heap of the events after the last bucket
+	size_t cursor;		// the current bucket, a heap (the later buckets are not in order)
+	size_t count;
+	EventSlab slab;
+
+	RecordBefore order() const { return RecordBefore{ &slab, byKey }; }
+	void advance();		// move the cursor to the next bucket with events
+};
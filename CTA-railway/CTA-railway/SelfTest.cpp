@@ -0,0 +1,223 @@
+//Header Files
+#include "util.hpp"
+#include "SelfTest.hpp"
+#include "ParallelEngine.hpp"
+
+// the suspend points of the checks, some of them at the same second as other events
+static const double TEST_SUSPENDS[] = { 25000.0, 36000.5, 47000.0, 58000.0 };
+
+// everything exportState() gives, to compare two simulators
+struct ExportedState {
+	double time;
+	std::vector<int> queueSize;
+	std::vector<double> delay;
+	std::vector<int> numPass;
+	std::vector<int> trainLoad;
+
+	ExportedState(Simulation& sim) : queueSize(sim.numStations * 2), delay(sim.numStations * 2), \
+		numPass(sim.numStations * 2), trainLoad(sim.getTrainNum()) {
+		StateBuffer buffer = { &time, queueSize.data(), delay.data(), numPass.data(), trainLoad.data() };
+		StateLayout layout = { NULL, 0 };
+		sim.exportState(buffer, layout);
+	}
+	bool operator==(const ExportedState& other) const {
+		return time == other.time && queueSize == other.queueSize && delay == other.delay && \
+			numPass == other.numPass && trainLoad == other.trainLoad;
+	}
+};
+
+static bool sameReport(const Report& left, const Report& right) {
+	return left.isFinished == right.isFinished && left.totalTravelTime == right.totalTravelTime && \
+		left.totalDelay == right.totalDelay && left.numDeparted == right.numDeparted && left.numArrived == right.numArrived;
+}
+
+static bool check(const char* name, bool passed, const std::string& detail) {
+	cout << (passed ? "PASS " : "FAIL ") << name;
+	if (!passed)
+		cout << ": " << detail;
+	cout << "\n";
+	return passed;
+}
+
+static bool testParallel(const Simulation& loaded) {
+	const int numStops = sizeof(TEST_SUSPENDS) / sizeof(TEST_SUSPENDS[0]) + 1;
+
+	// run() in key order to each suspend point and the end of the day
+	std::vector<Report> expected;
+	std::vector<ExportedState> expectedStates;
+	{
+		Simulation sim;
+		sim.init(loaded);
+		sim.setKeyOrder(true);
+		sim.seed(1);
+		for (int k = 0; k < numStops - 1; k++)
+			sim.addEvent(Event(TEST_SUSPENDS[k], SUSPEND));
+		for (int k = 0; k < numStops; k++) {
+			expected.push_back(sim.run());
+			expectedStates.push_back(ExportedState(sim));
+		}
+	}
+
+	const int partitions[] = { 1, 2, 8 };
+	for (int i = 0; i < 3; i++) {
+		Simulation sim;
+		sim.init(loaded);
+		sim.setKeyOrder(true);
+		sim.seed(1);
+		for (int k = 0; k < numStops - 1; k++)
+			sim.addEvent(Event(TEST_SUSPENDS[k], SUSPEND));
+		ParallelEngine engine;
+		for (int k = 0; k < numStops; k++) {
+			Report report = engine.run(sim, partitions[i]);
+			if (!sameReport(report, expected[k]) || !(ExportedState(sim) == expectedStates[k])) {
+				return check("parallel", false, std::to_string(partitions[i]) + " partitions (" + \
+					std::to_string(engine.partitionCount()) + " made) differ from run() at stop " + std::to_string(k) + \
+					": travel time " + std::to_string(report.totalTravelTime) + " / " + std::to_string(expected[k].totalTravelTime) + \
+					", arrived " + std::to_string(report.numArrived) + " / " + std::to_string(expected[k].numArrived));
+			}
+		}
+	}
+	return check("parallel", true, "");
+}
+
+// the same groups added by addODBatch() and by addEvent() one by one, many of them at the same
+// second, give the same day, in the default order and in key order. The groups take the stations
+// of the loaded fixed OD, so they all have a route, and the batch is big enough for the heap to be
+// built again in key order
+static bool testBatch(const Simulation& loaded) {
+	if (loaded.fixedOD.empty())
+		return check("batch", true, "");
+	const int numGroups = 20000;
+	std::vector<double> t(numGroups);
+	std::vector<int> from(numGroups), to(numGroups), num(numGroups);
+	for (int i = 0; i < numGroups; i++) {
+		const std::vector<int>& row = loaded.fixedOD[i * 7919 % loaded.fixedOD.size()];
+		t[i] = 30000.0 + (i * 7919 % 400) * 60.0;
+		from[i] = row[0];
+		to[i] = row[1];
+		num[i] = 1 + i % 5;
+	}
+
+	for (int keyOrder = 0; keyOrder < 2; keyOrder++) {
+		Simulation one;
+		one.init(loaded);
+		one.setKeyOrder(keyOrder != 0);
+		one.seed(1);
+		for (int i = 0; i < numGroups; i++) {
+			Event newODEvent(t[i], NEW_OD, false);
+			newODEvent.from = from[i];
+			newODEvent.to = to[i];
+			newODEvent.num = num[i];
+			one.addEvent(newODEvent);
+		}
+		Report expected = one.run();
+
+		Simulation batch;
+		batch.init(loaded);
+		batch.setKeyOrder(keyOrder != 0);
+		batch.seed(1);
+		batch.addODBatch(t.data(), from.data(), to.data(), num.data(), numGroups);
+		Report report = batch.run();
+
+		if (!sameReport(report, expected) || !(ExportedState(batch) == ExportedState(one))) {
+			return check("batch", false, std::string(keyOrder ? "in key order" : "in the default order") + \
+				", travel time " + std::to_string(report.totalTravelTime) + " / " + std::to_string(expected.totalTravelTime) + \
+				", arrived " + std::to_string(report.numArrived) + " / " + std::to_string(expected.numArrived));
+		}
+	}
+	return check("batch", true, "");
+}
+
+// a train at the end of its trip (at the terminal or short turned by an incident) puts off all
+// its passengers, so it must be empty in exportState(). The day is run with and without a
+// short turn on the line of station 0, then to the last event, when every train has ended
+static bool testTrainEnd(const Simulation& loaded) {
+	int lineID = loaded.stations[0].lineID;
+	int blocked = -1;
+	for (int i = 1; i < loaded.numStations && blocked < 0; i++) {
+		if (loaded.stations[i].lineID == lineID)
+			blocked = i;
+	}
+
+	for (int shortTurn = 0; shortTurn < 2; shortTurn++) {
+		Simulation sim;
+		sim.init(loaded);
+		sim.seed(1);
+		if (shortTurn && blocked >= 0)
+			sim.injectIncident(lineID, 0, blocked, 40000.0, 50000.0, INCIDENT_SHORT_TURN);
+		while (sim.hasEvents())
+			sim.run();
+
+		std::vector<int> trainLoad(sim.getTrainNum());
+		StateBuffer buffer = { NULL, NULL, NULL, NULL, trainLoad.data() };
+		StateLayout layout = { NULL, 0 };
+		sim.exportState(buffer, layout);
+		for (int trainID = 0; trainID < int(trainLoad.size()); trainID++) {
+			if (trainLoad[trainID] != 0) {
+				return check("train end", false, std::string(shortTurn ? "with" : "without") + " the short turn, train " + \
+					std::to_string(trainID) + " still carries " + std::to_string(trainLoad[trainID]) + " passengers");
+			}
+		}
+	}
+	return check("train end", true, "");
+}
+
+// the same routes whatever closures came before: a simulator closing and reopening on the way
+// ends with the table (policies and closures) of one closing only what is left closed
+static bool sameRoutes(const RouteTable& left, const RouteTable& right) {
+	for (int from = 0; from < left.size(); from++) {
+		for (int to = 0; to < left.size(); to++) {
+			if (!sameEntry(left.at(from, to), right.at(from, to)) || \
+				!sameClosure(left.closure(from, to, true), right.closure(from, to, true)) || \
+				!sameClosure(left.closure(from, to, false), right.closure(from, to, false)))
+				return false;
+		}
+	}
+	return true;
+}
+
+static bool testReroute(const Simulation& loaded) {
+	int N = loaded.numStations;
+	if (N < 4)
+		return check("reroute", true, "");
+	// a link on the paths of the loaded policies which has another way around it, and a station
+	const RouteTable& table = *loaded.routes;
+	Simulation fresh;
+	fresh.init(loaded);
+	int linkFrom = -1, linkTo = -1, expected = 0;
+	for (int i = 0; i < 16 && expected == 0; i++) {
+		linkFrom = N * i / 16;
+		linkTo = table.at(linkFrom, (linkFrom + N / 2) % N).policy[0];
+		if (linkTo >= 0 && linkTo < N && linkTo != linkFrom && (expected = fresh.closeLink(linkFrom, linkTo)) == 0)
+			fresh.reopenLink(linkFrom, linkTo);
+	}
+	int station = table.at(N / 2, 0).policy[0];
+	if (expected == 0 || station < 0 || station >= N)
+		return check("reroute", true, "");
+
+	Simulation changing;
+	changing.init(loaded);
+	changing.closeStation(station);
+	int snapshot = changing.snapshot();
+	changing.closeLink(linkFrom, linkTo);
+	changing.reopenStation(station);
+	changing.restore(snapshot);
+	changing.closeLink(linkFrom, linkTo);
+	int numChanged = changing.reopenStation(station);
+	return check("reroute", numChanged == expected && sameRoutes(*changing.routes, *fresh.routes), \
+		"closing " + std::to_string(linkFrom) + "-" + std::to_string(linkTo) + " changes " + std::to_string(numChanged) + \
+		" policies after other closures, " + std::to_string(expected) + " alone");
+}
+
+int runSelfTests(const Simulation& loaded) {
+	int failures = 0;
+	if (!testParallel(loaded))
+		failures++;
+	if (!testBatch(loaded))
+		failures++;
+	if (!testTrainEnd(loaded))
+		failures++;
+	if (!testReroute(loaded))
+		failures++;
+	return failures;
+}
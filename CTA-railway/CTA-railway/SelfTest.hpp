@@ -0,0 +1,15 @@
+#pragma once
+#include "Simulation.hpp"
+
+// The checks of what the other parts promise, on the loaded data, run with "--self-test". Each
+// check prints PASS or FAIL and what differs, runSelfTests() returns the number of failures.
+//	parallel	ParallelEngine gives the same reports and state as run() in key order to the last
+//				bit, with 1, 2 and 8 partitions, at the suspend points and at the end of the day
+//	batch		addODBatch() gives the same day as adding the groups with addEvent() one by one,
+//				in the default order and in key order
+//	train end	the trains which have ended (at a terminal or a short turn) carry nobody, run to
+//				the last event with and without a short turn
+//	reroute		the routes repaired after closing and reopening on the way are those of closing
+//				only what is left closed
+
+int runSelfTests(const Simulation& loaded);
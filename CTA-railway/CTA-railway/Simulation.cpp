@@ -2,19 +2,37 @@
 //Header Files
 #include "util.hpp"
 #include "Simulation.hpp"
+#include "Scheduler.hpp"
+#include "EventLog.hpp"
+#include "Fluid.hpp"
+#include <cstring>
 
-// Run Simulation
+// in key order, where the random numbers of an event start, from the event itself (a NEW_OD
+// pushed again has another time or station), see CounterRNG::moveTo()
+static unsigned long long randomPosition(const Event& event) {
+	unsigned long long timeBits;
+	memcpy(&timeBits, &event.time, sizeof(timeBits));
+	return event.key ^ (timeBits * 0x9E3779B97F4A7C15ull) ^ ((unsigned long long)(unsigned int)event.from << 40);
+}
+
+// Run Simulation, the diagnostics go to the asynchronous log, see EventLog.hpp
 Report Simulation::run() {
 
 	do {
-		if (EventQueue.empty()) {
-			std::cout << "Empty Queue!" << std::endl;
+		if (EventQueue->empty()) {
+			eventLog().log(LOG_EMPTY_QUEUE, time);
 			return report();
 		}
 		else {
-			Event nextevent = EventQueue.top();
-			EventQueue.pop();
+			Event nextevent = EventQueue->pop();
 			time = nextevent.time;
+			if (time >= sliceEnd)
+				updateSlice();
+			if (keyOrder)
+				rng.moveTo(randomPosition(nextevent));
+			numEvents++;
+			STATS(stats.counters[STAT_ARRIVAL_EVENTS + nextevent.type]++);
+			STATS(long long startCycles = (numEvents % STAT_CYCLE_SAMPLING == 0) ? readCycles() : 0);
 			
 			//// debug
 			//cout << time;
@@ -30,103 +48,114 @@ Report Simulation::run() {
 				int station = train->arrivingStation;
 				int direction = train->direction;
 				int& capacity = train->capacity;
-				int* destination = train->destination;
+				Destinations& destination = train->destination;
 				int& passengerNum = train->passengerNum;
 				int lineID = train->lineID;
 
 				// debug
-				if (_last_time > time) {
-					cout << "ERROR: time error!\n";
-					cout << "last time: " << _last_time << "\n";
-					cout << "current time: " << time << "\n";
-				}
+				if (_last_time > time)
+					eventLog().log(LOG_TIME_ERROR, time, station, trainID, 0, _last_time);
 
 				// calculate travel time and passenger get off
-				totalTravelTime += passengerNum * (time - train->lastTime);
-				passengerNum -= destination[station];
-				capacity += destination[station];
-				num_arrived += destination[station];
-				destination[station] = 0;
+				totalTravelTime += amount(passengerNum * (time - train->lastTime));
+				if (fluidRecord)
+					(*fluidRecord)[slice].onboard[station * 2 + direction] += passengerNum;
+				int arrived_num = destination.take(station);
+				if (fluidRecord)
+					recordFluid(station * 2 + direction, station, station, 0.0, arrived_num, false);
+				passengerNum -= arrived_num;
+				capacity += arrived_num;
+				num_arrived += arrived_num;
 
 				// if it's a transfer station, do the transfer (add new OD to the stations)
+				// only the occupied destinations are visited, in the order of the station ID
 				if (stations[station].isTransfer) {
-					for (int dest_station = 0; dest_station < TOTAL_STATIONS; dest_station++) {
-						if (destination[dest_station] > 0) {
-							// first, find the passengers whose trip is finished ( not at this station,
-							// but at its transfer station ), finish them!
-							double transfer_time = 0.0;
-							int real_station = getRealStation(station, dest_station, transfer_time);
-
-							// arriving the destination
-							if (real_station == dest_station) { 
-								// meaning that passengers can transfer to the destination without taking a train
-								int off_num = destination[dest_station];
-								passengerNum -= destination[dest_station];
-								capacity += destination[dest_station];
-								num_arrived += destination[dest_station];	// consider them as arriving the dest
-								destination[dest_station] = 0;
-								totalTravelTime += transfer_time * off_num;
-
-								// skip the transfer check
-								continue;
-							}
-
-							// really need a transfer
-							if (transferTime[station][getNextStation(station, dest_station, lineID)] != -1) {
-								// meaning the passenger should transfer,
-								// assume the passengers directly go to the real station
-
-								// 1. get off the train
-								int num_transfer = destination[dest_station];
-								passengerNum -= num_transfer;
-								capacity += num_transfer;
-								destination[dest_station] = 0;
-
-								// 2. count the time they walk to the transfer station
-								totalTravelTime += transfer_time * num_transfer;
-
-								// 3. create a new OD event for these passengers
-								Event newEvent(time + transfer_time, NEW_OD, true);
-								newEvent.from = real_station;
-								newEvent.to = dest_station;
-								newEvent.num = num_transfer;
-								EventQueue.push(newEvent);
-							}
+					int i = 0;
+					while (i < destination.size()) {
+						int dest_station = destination.stationAt(i);
+						// first, find the passengers whose trip is finished ( not at this station,
+						// but at its transfer station ), finish them!
+						double transfer_time = 0.0;
+						int real_station = getRealStation(station, dest_station, transfer_time);
+
+						// arriving the destination
+						if (real_station == dest_station) { 
+							// meaning that passengers can transfer to the destination without taking a train
+							int off_num = destination.numAt(i);
+							if (fluidRecord)
+								recordFluid(station * 2 + direction, dest_station, dest_station, transfer_time, off_num, false);
+							passengerNum -= off_num;
+							capacity += off_num;
+							num_arrived += off_num;	// consider them as arriving the dest
+							destination.removeAt(i);
+							totalTravelTime += amount(transfer_time * off_num);
+
+							// skip the transfer check
+							continue;
 						}
+
+						// really need a transfer
+						if (routes->at(station, getNextStation(station, dest_station, lineID)).transferTime != -1) {
+							// meaning the passenger should transfer,
+							// assume the passengers directly go to the real station
+
+							// 1. get off the train
+							int num_transfer = destination.numAt(i);
+							if (fluidRecord)
+								recordFluid(station * 2 + direction, real_station, dest_station, transfer_time, num_transfer, false);
+							passengerNum -= num_transfer;
+							capacity += num_transfer;
+							destination.removeAt(i);
+
+							// 2. count the time they walk to the transfer station
+							totalTravelTime += amount(transfer_time * num_transfer);
+
+							// 3. create a new OD event for these passengers
+							Event newEvent(time + transfer_time, NEW_OD, true);
+							newEvent.key = trainODKey(trainID, train->numODs++);
+							newEvent.from = real_station;
+							newEvent.to = dest_station;
+							newEvent.num = num_transfer;
+							EventQueue->push(newEvent);
+							STATS(stats.counters[STAT_TRANSFER_ODS]++);
+							continue;
+						}
+						i++;
 					}
 				}
 
 				// if not terminal, new passengers board and calculate delay and travel time
 				// !stations[station].isTerminal[direction] && 
 				if (!trainEnd(trainID)) {
-					Q* passengerQueue = &stations[station].queue[direction];
+					int passengerQueue = station * 2 + direction;
+					STATS(stats.queueHistogram[passengerQueue * STAT_QUEUE_BUCKETS + queueBucket(stations[station].queueSize[direction])]++);
 
 					// calculate delay and total travel time
 					double delta_time = (time - stations[station].avg_inStationTime[direction]) * (double)stations[station].queueSize[direction];
 					/*if (delta_time < 0)
 						cout << "ERROR: negative delay!\n";*/
-					totalDelay += delta_time;
-					totalTravelTime += delta_time;
+					totalDelay += amount(delta_time);
+					totalTravelTime += amount(delta_time);
 					stations[station].avg_inStationTime[direction] = time;
 					stations[station].delay[direction] += delta_time;		// count the delay contributed by the station
 
 					// if there is space on the train, get the passengers (if existing) onto the train
-					while (!passengerQueue->empty() && capacity > 0) {
-						WaitingPassengers* passengers = &passengerQueue->front();
+					while (!queues.empty(passengerQueue) && capacity > 0) {
+						WaitingPassengers* passengers = &queues.front(passengerQueue);
 
 						if (passengers->numPassengers <= capacity) {
 							// all this destination group get on the train, update the passenger num on and off the train
 							capacity -= passengers->numPassengers;
 							passengerNum += passengers->numPassengers;
-							destination[passengers->destination] += passengers->numPassengers;
+							destination.add(passengers->destination, passengers->numPassengers);
 							stations[station].queueSize[direction] -= passengers->numPassengers;
-							passengerQueue->pop();
+							queues.pop(passengerQueue);
 						}
 						else {
 							// part of this destination group get on the train, update the passenger num on and off the train
 							passengers->numPassengers -= capacity;
 							passengerNum += capacity;
-							destination[passengers->destination] += capacity;
+							destination.add(passengers->destination, capacity);
 							stations[station].queueSize[direction] -= capacity;
 							capacity = 0;
 							break;
@@ -137,43 +166,49 @@ Report Simulation::run() {
 					nextevent.time = getNextArrivalTime(trainID);
 					train->arrivingStation = getNextArrivalStationID(trainID);
 					train->lastTime = time;
-					EventQueue.push(nextevent);
+					EventQueue->push(nextevent);
 				}
 
-				// if is terminal (maybe because of the incident), delete the train
+				// if is terminal (maybe because of the incident), the train stops (stays in the pool)
 				// (debug) report the passenger numbers on the train
 				else{
 					if (passengerNum > 0) {
 						if (!stations[station].isTerminal[direction])
-							cout << passengerNum << " passengers not cleared at temperary terminal " << station << "!\n";
+							eventLog().log(LOG_NOT_CLEARED_TEMPORARY, time, station, trainID, passengerNum);
 						else
-							cout << "ERROR: " << passengerNum << " passengers not cleared at fixed terminal station " << station << "!\n";
+							eventLog().log(LOG_NOT_CLEARED_TERMINAL, time, station, trainID, passengerNum);
 					}
 					// Here to deal with the passengers whose trip is not yet finished, if exist.
 					// These people are neither transfering nor arriving at the destination,
 					// thus, we only need to add them back to the queues.
-					for (int dest_station = 0; dest_station < TOTAL_STATIONS; dest_station++) {
-						if (destination[dest_station] > 0) {
-							// directly add new OD pairs
-							Event newODEvent(time, NEW_OD, true);
-							newODEvent.from = station;
-							newODEvent.to = dest_station;
-							newODEvent.num = destination[dest_station];
-							EventQueue.push(newODEvent);
-						}
+					for (int i = 0; i < destination.size(); i++) {
+						// directly add new OD pairs
+						Event newODEvent(time, NEW_OD, true);
+						newODEvent.key = trainODKey(trainID, train->numODs++);
+						newODEvent.from = station;
+						newODEvent.to = destination.stationAt(i);
+						newODEvent.num = destination.numAt(i);
+						if (fluidRecord)
+							recordFluid(station * 2 + direction, station, newODEvent.to, 0.0, newODEvent.num, true);
+						EventQueue->push(newODEvent);
 					}
-					delete train;
+					// they are off the train now, so they are not counted twice (e.g. by exportState())
+					capacity += passengerNum;
+					passengerNum = 0;
+					destination.clear();
 				}
 
 			}
 			else if (nextevent.type == SUSPEND) {
 				// return immediate cost for the RL model to make decision
+				STATS(if (startCycles != 0) stats.counters[STAT_SUSPEND_CYCLES] += (readCycles() - startCycles) * STAT_CYCLE_SAMPLING);
+				_last_time = time;
 				return report();
 			}
 			else if (nextevent.type == NEW_OD) {
 				// add new OD pairs
 				if (nextevent.from == nextevent.to) {
-					cout << "illegal OD pair from " << nextevent.from << " to " << nextevent.to << " at time " << time << "!\n";
+					eventLog().log(LOG_ILLEGAL_OD, time, nextevent.from, -1, nextevent.num, nextevent.to);
 				}
 				else {
 					// check the real station
@@ -189,19 +224,27 @@ Report Simulation::run() {
 
 					// b. can transfer to the destination
 					else if (real_station == nextevent.to) {
-						totalTravelTime += transfer_time;
+						totalTravelTime += amount(transfer_time);
 					}
 
 					// c. still need a transfer
-					else {
-						totalTravelTime += transfer_time;
+					else if (real_station != nextevent.from) {
+						STATS(stats.counters[STAT_TRANSFER_REPUSHES]++);
+						totalTravelTime += amount(transfer_time);
 						nextevent.from = real_station;
 						nextevent.time = time + transfer_time;
-						EventQueue.push(nextevent);
+						EventQueue->push(nextevent);
+					}
+
+					// d. too early (e.g. the OD of simple_data), wait until START_TIME
+					else {
+						nextevent.time = START_TIME;
+						EventQueue->push(nextevent);
 					}
 				}
 			}
-
+			STATS(if (startCycles != 0) stats.counters[STAT_ARRIVAL_CYCLES + nextevent.type] += \
+				(readCycles() - startCycles) * STAT_CYCLE_SAMPLING);
 		}
 
 		_last_time = time;
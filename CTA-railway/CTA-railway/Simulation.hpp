@@ -1,27 +1,41 @@
 #pragma once
+#include <algorithm>
 #include <cstdlib>
 #include <ctime>
 #include <iostream>
 #include <fstream>
 #include <math.h>
+#include <memory>
 #include <queue>
+#include <random>
 #include <vector>
 #include <string>
+#include "Stats.hpp"
 
-#define TOTAL_STATIONS 252	// øĳclassԱinitгʼ
 #define DEFAULT_CAPACITY 500
 #define START_TIME 18000	// not add passengers into the system until 5:00
 #define WARMUP_PERIOD 0
 #define SIMULATION_END_TIME 64800
+#define DATA_DIR "data"	// the default directory of the data files
 #define MAX_POLICY_NUM 1	// the largest possible num of optimal policy from station i to station j
+#ifndef COMPRESS_ROUTES_FROM
+#define COMPRESS_ROUTES_FROM 1024	// the route tables of this many stations or more are compressed, see RouteTable.
+#endif								// e.g. /DCOMPRESS_ROUTES_FROM=0 to compress all of them
 
 // declaration
 struct Report;				// the struct to report to the RL model
 struct WaitingPassengers;	// the struct to store the information of waiting passenegers in a queue
 struct Train;				// the struct to store the information of a train
+struct SimState;			// the struct to store a copy of the simulation state
+struct StateBuffer;			// the arrays to export the state into, see exportState()
+struct StateLayout;			// which stations to export, see exportState()
+class EventScheduler;		// the queue of the future events, see Scheduler.hpp
+struct RoutingGraph;		// the network to repair the policies on, see Rerouting.hpp
+class RoutingIndex;			// the policy set of each time slice, see RoutingIndex.hpp
+class ParallelEngine;		// runs the lines on several threads, see ParallelEngine.hpp
+struct FluidModel;			// the aggregated routes of runFluid(), see Fluid.hpp
+struct FluidFlows;			// what the model is made from, see Fluid.hpp
 
-//Vector of Queues for passengers
-typedef std::queue<WaitingPassengers> Q;
 //typedef std::vector<Q> vecQ;
 //typedef std::vector<int> transfer_list;
 
@@ -32,6 +46,23 @@ enum EventType {
 	NEW_OD		// to add new OD pairs (including the transfer passengers)
 };
 
+enum SchedulerType {
+	// the implementations of the event queue, see Scheduler.hpp
+	BINARY_HEAP,
+	QUATERNARY_HEAP,
+	CALENDAR_QUEUE
+};
+
+enum IncidentType {
+	// what happens to the trains running into the blocked part of a line, see injectIncident()
+	INCIDENT_DELAY,			// they wait before the blocked part until the incident ends
+	INCIDENT_SHORT_TURN		// they end their trips at the station before the blocked part
+};
+
+#ifndef DEFAULT_SCHEDULER
+#define DEFAULT_SCHEDULER BINARY_HEAP	// can be set by the compiler options, e.g. /DDEFAULT_SCHEDULER=CALENDAR_QUEUE
+#endif
+
 struct WaitingPassengers {
 	//int arrivingTime;
 	int numPassengers;
@@ -50,22 +81,56 @@ struct Event {
 	// the base class for events
 	EventType type;			// the type of the event
 	double time;			// the happening time of the event, in the unit of sec
+	unsigned long long key;	// orders the events at the same time in key order, see eventBefore()
 	int from, to, num;		// if is a transfer OD, use the compact format of [int from, int to, int num]
-	Train* train;			// handle of the arriving train
 	bool isTransfer;		// mark if the OD is from a transfer behavior
+	Train* train;			// handle of the arriving train
 	
 	// init function
-	Event(double t, EventType type = ARRIVAL, bool isTransfer = false) : time(t), type(type), from(-1), to(-1),\
-		num(0), train(NULL), isTransfer(isTransfer) { }
+	Event(double t, EventType type = ARRIVAL, bool isTransfer = false) : type(type), time(t), key(0), from(-1), to(-1),\
+		num(0), isTransfer(isTransfer), train(NULL) { }
 };
 
-//Compare events for Priority Queue
+// The order of the events at the same time. run() leaves it to the queue as it always did: the
+// binary heap serves them in the order its layout gives, the other queues in the order they are
+// pushed (see Scheduler.hpp). In key order (Simulation::setKeyOrder(), used by ParallelEngine)
+// they are handled in the order of their keys, which are made from what the event is (not from
+// where it is in a queue), so every queue and every partition handles them in the same order:
+// the suspends first, then the ODs, then the arrivals. The key of an arrival is its train, that
+// of an OD is the order it was loaded/added in, or the train which put it off and how many it
+// put off before
+#define KEY_OD (1ull << 62)
+#define KEY_TRAIN_OD (KEY_OD | (1ull << 61))
+#define KEY_ARRIVAL (2ull << 62)
+inline unsigned long long suspendKey(unsigned long long seq) { return seq; }
+inline unsigned long long odKey(unsigned long long seq) { return KEY_OD | seq; }
+inline unsigned long long trainODKey(int trainID, unsigned int n) { return KEY_TRAIN_OD | ((unsigned long long)trainID << 32) | n; }
+inline unsigned long long arrivalKey(int trainID) { return KEY_ARRIVAL | (unsigned long long)trainID; }
+
+inline bool eventBefore(const Event& left, const Event& right) {
+	return left.time < right.time || (left.time == right.time && left.key < right.key);
+}
+
+//Compare events for Priority Queue, by the time only unless in key order
 struct EventCompare {
-	bool operator() (const Event left, const Event right) const {
-		return left.time > right.time;
+	bool byKey;
+
+	EventCompare(bool byKey = false) : byKey(byKey) {}
+	bool operator() (const Event& left, const Event& right) const {
+		return byKey ? eventBefore(right, left) : left.time > right.time;
 	}
 };
 
+//Priority Queue for the events, with access to the underlying container
+//so that the whole heap can be copied or cleared at once
+class EventHeap : public std::priority_queue < Event, std::vector<Event, std::allocator<Event> >, EventCompare > {
+public:
+	EventHeap(bool byKey = false) : std::priority_queue < Event, std::vector<Event, std::allocator<Event> >, EventCompare >(EventCompare(byKey)) {}
+	std::vector<Event>& container() { return c; }
+	const EventCompare& compare() const { return comp; }
+	void clear() { c.clear(); }
+};
+
 class Station {
 	// Each station in the system has a unique ID. For the transfer stations, consider there are 
 	// several independent stations in each line, which have different IDs.
@@ -76,8 +141,7 @@ public:
 	bool isTerminal[2];		// if the station is the terminal station
 	bool isTransfer;		// if the station is a transfer station
 
-	// variable
-	Q queue[2];				// passenger queues for both directions
+	// variable, the passenger queues are kept by the simulator, see PassengerQueues
 	int queueSize[2];		// record the number of passengers waiting in the queues of both directions
 	double avg_inStationTime[2];	//avg arriving time of passengers in the queue, used for delay calculation
 	double delay[2];		// delay contributed by the direction
@@ -100,6 +164,59 @@ public:
 	}
 };
 
+// The passenger queues of all the stations (2 for each station, index stationID * 2 + direction).
+// Each queue is a ring buffer in one arena shared by all of them. A group heading for the same
+// station as the last group in the queue is merged into it, the order of boarding is the same.
+// A full ring is moved to the end of the arena with double size, and clear() lays the rings
+// out again with the size they have reached, so a reset keeps the memory for the next run.
+class PassengerQueues {
+public:
+	void reset(int numQueues);		// empty all the queues, (re)create them if the number changes
+	bool empty(int q) const { return rings[q].count == 0; }
+	WaitingPassengers& front(int q) { return arena[rings[q].offset + rings[q].head]; }
+	void pop(int q) {
+		Ring& ring = rings[q];
+		ring.head = (ring.head + 1) & ring.mask;
+		ring.count--;
+	}
+	void push(int q, int destination, int num);
+	void assign(int q, const PassengerQueues& other);	// make queue q a copy of the queue q of another
+
+private:
+	struct Ring {
+		unsigned int offset;	// where the ring starts in the arena
+		unsigned int mask;		// capacity - 1, the capacity is a power of 2
+		unsigned int head;
+		unsigned int count;
+	};
+	std::vector<Ring> rings;
+	std::vector<WaitingPassengers> arena;
+
+	void grow(int q);
+};
+
+// the numbers of passengers on a train heading for each station. Only the occupied destinations
+// are stored, sorted by the station ID, with 16-bit IDs and counts, so an arrival only visits
+// the stations someone is going to and a train takes a few bytes instead of one int per station
+class Destinations {
+public:
+	int size() const { return int(slots.size()); }		// number of occupied destinations
+	int stationAt(int i) const { return slots[i].station; }
+	int numAt(int i) const { return slots[i].num; }
+	void removeAt(int i) { slots.erase(slots.begin() + i); }
+	void add(int station, int num);		// 'num' passengers heading for 'station' get on
+	int take(int station);				// the passengers heading for 'station' get off, return the number
+	void clear() { slots.clear(); }
+
+private:
+	struct Slot {
+		unsigned short station;
+		unsigned short num;
+	};
+	std::vector<Slot> slots;			// sorted by the station ID
+	int find(int station) const;		// the index of the first slot not before 'station'
+};
+
 struct Train {
 	// the information about the train
 	int trainID;			// the unique ID of a train from a terminal to the other terminal
@@ -109,12 +226,275 @@ struct Train {
 	int capacity;			// the remaining space on the train
 	double lastTime;		// the time that the train set out at last station,
 							// if the train is being initialized, set 'lastTime' to be the set out time at the starting station
-	int destination[TOTAL_STATIONS] = { 0 };// numbers of passengers heading for each station
+	Destinations destination;	// numbers of passengers heading for each station
 	int passengerNum;		// total number of passengers on the train
+	unsigned int numODs;	// the NEW_OD events it has made (the passengers put off), for their keys
 
 	Train(int trainID, int lineID, int direction, int arrivingStation, double startTime, int capacity = DEFAULT_CAPACITY) : \
 		trainID(trainID), lineID(lineID), direction(direction), passengerNum(0), \
-		arrivingStation(arrivingStation), lastTime(startTime), capacity(capacity) {}
+		arrivingStation(arrivingStation), lastTime(startTime), capacity(capacity), numODs(0) {}
+};
+
+// everything about going from station i to station j, packed together so that
+// a query touches only one entry (aligned to 32 bytes, so it doesn't cross a cache line)
+struct alignas(32) RouteEntry {
+	int policy[MAX_POLICY_NUM];
+	// the optimal policy--what is the next station to go if the passenger is traveling
+	// from station i to station j
+	// considering that there may be several optimal solutions between two stations, at most MAX_POLICY_NUM
+	// policies can be stored here
+	int policy_offpeak[MAX_POLICY_NUM];
+	// the policy for off-peak hours when the P line is not fully running
+	int policy_num;			// the num of the optimal paths from station i to station j
+	int direction;			// the direction from station i to station j, only when i and j are adjacent stations
+	double transferTime;	// the transfer time between two transfer stations, -1 if not transfer stations
+};
+
+// where a passenger from station i to station j really gets on the train, i.e. the result of
+// getRealStation() and the direction to go there, for one policy set (peak or off-peak)
+struct TransferClosure {
+	int realStation;		// -1 if a random choice is made on the way, then getRealStation() walks as before
+	int direction;			// the direction to take at the real station, -1 if the real station is the destination
+	double transferTime;	// the total transfer time to walk to the real station
+};
+
+// if two entries/closures are the same, to compress the runs of them
+inline bool sameEntry(const RouteEntry& left, const RouteEntry& right) {
+	for (int k = 0; k < MAX_POLICY_NUM; k++) {
+		if (left.policy[k] != right.policy[k] || left.policy_offpeak[k] != right.policy_offpeak[k])
+			return false;
+	}
+	return left.policy_num == right.policy_num && left.direction == right.direction && left.transferTime == right.transferTime;
+}
+
+inline bool sameClosure(const TransferClosure& left, const TransferClosure& right) {
+	return left.realStation == right.realStation && left.direction == right.direction && left.transferTime == right.transferTime;
+}
+
+// a value to put at (row, col) of a RunMatrix, see RunMatrix::setCells()
+template <typename T>
+struct RunCell {
+	int row;
+	int col;
+	T value;
+};
+
+template <typename T>
+inline bool cellBefore(const RunCell<T>& left, const RunCell<T>& right) {
+	return left.row < right.row || (left.row == right.row && left.col < right.col);
+}
+
+// A matrix kept row by row as the runs of equal values: the run k of a row covers the columns
+// from firstCol[k] to the next run, and has values[k]. The stations of a line have consecutive
+// IDs, so the routes from a station to most of a line are the same and a row of the route table
+// is a few runs for each line instead of N entries. A query is a binary search in the row.
+template <typename T>
+class RunMatrix {
+public:
+	RunMatrix() : rowStart(1, 0) {}
+
+	void clear() {
+		rowStart.assign(1, 0);
+		firstCol.clear();
+		values.clear();
+	}
+	int rows() const { return int(rowStart.size()) - 1; }
+	const T& at(int row, int col) const {
+		const int* begin = firstCol.data() + rowStart[row];
+		const int* end = firstCol.data() + rowStart[row + 1];
+		return values[(std::upper_bound(begin, end, col) - firstCol.data()) - 1];
+	}
+	// append the next row of n values, 'same' tells if two values are equal
+	template <typename Same>
+	void appendRow(const T* row, int n, Same same) {
+		if (n > 0) {
+			firstCol.push_back(0);
+			values.push_back(row[0]);
+		}
+		for (int col = 1; col < n; col++) {
+			if (!same(row[col], row[col - 1])) {
+				firstCol.push_back(col);
+				values.push_back(row[col]);
+			}
+		}
+		rowStart.push_back(int(firstCol.size()));
+	}
+	// change some cells of a matrix with n columns without expanding it: the runs of the rows
+	// without a change are kept, those with one are split (and joined to their neighbours if equal).
+	// 'cells' are sorted by cellBefore(), at most one for each cell
+	template <typename Same>
+	void setCells(const std::vector<RunCell<T>>& cells, int n, Same same) {
+		if (cells.empty())
+			return;
+		std::vector<int> newStart(1, 0);
+		std::vector<int> newFirstCol;
+		std::vector<T> newValues;
+		newFirstCol.reserve(firstCol.size() + cells.size() * 2);
+		newValues.reserve(values.size() + cells.size() * 2);
+		size_t i = 0;
+		for (int row = 0; row < rows(); row++) {
+			int begin = int(newFirstCol.size());
+			auto add = [&](int col, const T& value) {
+				if (int(newFirstCol.size()) > begin && same(newValues.back(), value))
+					return;
+				newFirstCol.push_back(col);
+				newValues.push_back(value);
+			};
+			for (int k = rowStart[row]; k < rowStart[row + 1]; k++) {
+				int end = (k + 1 < rowStart[row + 1]) ? firstCol[k + 1] : n;
+				int col = firstCol[k];
+				for (; i < cells.size() && cells[i].row == row && cells[i].col < end; i++) {
+					if (cells[i].col > col)
+						add(col, values[k]);
+					add(cells[i].col, cells[i].value);
+					col = cells[i].col + 1;
+				}
+				if (col < end)
+					add(col, values[k]);
+			}
+			newStart.push_back(int(newFirstCol.size()));
+		}
+		rowStart.swap(newStart);
+		firstCol.swap(newFirstCol);
+		values.swap(newValues);
+	}
+	size_t bytes() const { return (rowStart.size() + firstCol.size()) * sizeof(int) + values.size() * sizeof(T); }
+
+	std::vector<int> rowStart;	// rows + 1, where the runs of each row start
+	std::vector<int> firstCol;	// the first column of each run
+	std::vector<T> values;		// the value of each run
+};
+
+// the N x N matrix of RouteEntry in one block, row-major (from, to), aligned to the cache line.
+// N is the number of stations in the loaded data.
+// the transfer closures of both policy sets are kept next to each other in the same (from, to) order.
+// A big table (COMPRESS_ROUTES_FROM stations or more) is compressed into a RunMatrix instead, the
+// entries and closures are the same, with a binary search in the row for each query. Changing an
+// entry with edit() expands it back into the block (e.g. while loading), setCompressed() again when
+// the changes are done. setEntries() changes some entries in either form, without expanding
+class RouteTable {
+public:
+	RouteTable(int numStations, bool compressed = false);	// no path between any two stations
+	~RouteTable();
+	RouteTable(const RouteTable& other);	// a copy to be changed, e.g. by the closures of the links
+	RouteTable& operator=(const RouteTable&) = delete;
+
+	int size() const { return numStations; }
+	const RouteEntry& at(int from, int to) const {
+		if (entries != NULL)
+			return entries[size_t(from) * numStations + to];
+		return compactEntries.at(from, to);
+	}
+	RouteEntry& edit(int from, int to);		// the entry to change, a compressed table is expanded first
+	void setEntries(std::vector<RunCell<RouteEntry>>& cells);	// (from, to, entry), the last of a cell wins
+	RouteEntry* data() { return entries; }	// the block, NULL if compressed
+	size_t bytes() const { return size_t(numStations) * numStations * sizeof(RouteEntry); }
+
+	// the transfer closure from station i to station j, 'peak' chooses the policy set
+	const TransferClosure& closure(int from, int to, bool peak) const {
+		if (entries != NULL)
+			return closures[(size_t(from) * numStations + to) * 2 + (peak ? 0 : 1)];
+		return compactClosures[peak ? 0 : 1].at(from, to);
+	}
+	void buildClosure();	// compute the transfer closures, must be called again if the policies change
+	void buildClosure(std::vector<std::pair<int, int>> cells);	// compute them again for some (from, to),
+																// after the policies they walk through change
+
+	bool isCompressed() const { return entries == NULL; }
+	void setCompressed(bool compressed);	// compress or expand the entries and the closures
+	RunMatrix<RouteEntry>& compressedEntries() { return compactEntries; }	// for the data cache
+	size_t memoryBytes() const;		// the memory of the entries and the closures
+
+	std::vector<std::vector<int>> repairs;	// of a table repaired for closures (see Simulation::updateRoutes()):
+											// by destination, from * 2 + policy set of each repaired policy
+
+private:
+	int numStations;
+	char* memory;			// the allocated block, 'entries' is the aligned part of it
+	RouteEntry* entries;
+	std::vector<TransferClosure> closures;	// [from][to][peak, off-peak]
+	RunMatrix<RouteEntry> compactEntries;	// [from][to] when compressed
+	RunMatrix<TransferClosure> compactClosures[2];	// [peak, off-peak][from][to] when compressed
+
+	void allocate();		// the block of entries, not initialized
+	TransferClosure walkClosure(int start, int to, bool peak) const;
+};
+
+// Counter-based random numbers: the n-th number of a stream is a hash of (key, n), so a
+// stream is given by (seed, stream ID) only, e.g. one stream for each replication, and
+// the streams are independent and reproducible whatever the threads do. The state is two
+// integers, cheap to copy into a snapshot. Usable as a std random engine.
+class CounterRNG {
+public:
+	typedef unsigned int result_type;
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return 0xFFFFFFFFu; }
+
+	CounterRNG(unsigned long long seed = 0, unsigned long long stream = 0) { this->seed(seed, stream); }
+	void seed(unsigned long long seed, unsigned long long stream = 0) {
+		key = mix(mix(seed) ^ (stream * 0xD1B54A32D192ED03ull));
+		counter = 0;
+	}
+	result_type operator()() { return result_type(mix(key + (counter++) * 0x9E3779B97F4A7C15ull) >> 32); }
+	// go to the numbers of an event, given by what the event is instead of how many numbers came
+	// before, so an event gets the same numbers in whatever order the events are handled
+	void moveTo(unsigned long long position) { counter = mix(position); }
+
+private:
+	unsigned long long key;
+	unsigned long long counter;
+
+	// the finalizer of splitmix64
+	static unsigned long long mix(unsigned long long z) {
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		return z ^ (z >> 31);
+	}
+};
+
+// In key order the amounts added to totalTravelTime and totalDelay are rounded to 1/65536 sec,
+// so the sums are exact (up to about 2^37 sec) and the same amounts added in any order give the
+// same bits, e.g. the totals of the partitions of ParallelEngine added up at the end
+#define TIME_SUM_UNITS 65536.0
+inline double exactAmount(double value) { return double(llround(value * TIME_SUM_UNITS)) / TIME_SUM_UNITS; }
+
+// a trip of the timetable as it was before an incident changed it, to undo the change
+struct TripEdit {
+	int row;							// the row of the train in startTrainInfo
+	int startTime;
+	std::vector<double> arrivalTime;
+	std::vector<int> arrivalStationID;
+};
+
+// a copy of everything that changes during the simulation, used to go back to a
+// certain time (e.g. the start of the control period) without running from 0:00 again
+struct SimState {
+	double time;
+	double _last_time;
+	double totalTravelTime;
+	double totalDelay;
+	int num_departed;
+	int num_arrived;
+	long long numEvents;
+	unsigned long long nextKey;
+	bool keyOrder;
+
+	EventScheduler* events;			// a copy of the event queue
+	std::vector<Train> trains;		// copies of the trains on the way, put back into the pool by trainID
+	std::vector<Station> stations;
+	PassengerQueues queues;			// the passenger queues of the stations
+	CounterRNG rng;					// so that the random choices after restore() are the same
+	std::vector<int> time_iter;
+	std::vector<int> stationID_iter;
+	std::vector<TripEdit> edits;		// the undo log of the incidents
+	std::vector<TripEdit> editedTrips;	// the trips changed by the incidents, as they were
+	std::shared_ptr<RouteTable> routes;			// the policies for the closed links and stations
+	std::shared_ptr<RouteTable> loadedRoutes;
+	std::vector<std::pair<int, int>> closedLinks;
+	std::vector<int> closedStations;
+
+	SimState() : events(NULL) {}
+	~SimState();
 };
 
 //Simulation Class
@@ -126,28 +506,15 @@ public:
 	double totalDelay;		// the off-train delay, namely the waiting time in the station queue
 	int num_departed;		// number of passengers put into the system
 	int num_arrived;		// number of passengers arrived at the destination
+	long long numEvents;	// number of events handled since reset(), to measure the speed
+	bool loadedFromCache;	// if init() read the tables from the binary image, not the csv files
+	unsigned long long nextKey;	// the key of the next event added from outside, see eventBefore()
 
-	int** policy_num; // [TOTAL_STATIONS] [TOTAL_STATIONS] = { 0 };
-	// the matrix stores the num of the optimal paths from station i to station j
-
-	int*** policy; // [TOTAL_STATIONS] [TOTAL_STATIONS] [MAX_POLICY_NUM] = { -1 };
-	// the matrix stores the optimal policy--what is the next station to go if the passenger is traveling
-	// from station i to station j
-	// considering that there may be several optimal solutions between two stations, at most MAX_POLICY_NUM 
-	// policies can be stored here
-
-	int*** policy_offpeak; //	[TOTAL_STATIONS] [TOTAL_STATIONS] [MAX_POLICY_NUM] = { -1 };
-	// the policy matrix for off-peak hours when the P line is not fully running
-
-	int** directions; //  [TOTAL_STATIONS] [TOTAL_STATIONS] = { -1 };
-	// return the direction from station i to station j
-	// only when i and j are adjacent stations
+	int numStations;		// the number of stations, from the loaded data
 
-	double** transferTime; // [TOTAL_STATIONS] [TOTAL_STATIONS] = { -1 };
-	// this matrix stores the transfer time between two transfer stations.
-
-	//int lineIDOfStation[TOTAL_STATIONS] = { -1 };
-	// an array to store the ID of the line that the station belongs to
+	std::shared_ptr<RouteTable> routes;
+	// the policies, directions and transfer times between each two stations, see RouteEntry.
+	// never changed after loading, so it can be shared by several simulators
 
 	std::vector<std::vector<int>> startTrainInfo;
 	// a 2-d matrix to store the information of train starting from the starting station, for reset().
@@ -164,34 +531,101 @@ public:
 	std::vector<std::vector<int>> fixedOD;
 	// a 2-d matrix to store the fixed OD data;
 
-	Simulation() : time(0), totalTravelTime(0), totalDelay(0), num_departed(0), num_arrived(0), EventQueue() {
-		srand((unsigned int)(std::time(NULL)));
-	}
+	Simulation();
+	~Simulation();
+	// the simulator owns the trains and the iterators, so it can't be copied
+	Simulation(const Simulation&) = delete;
+	Simulation& operator=(const Simulation&) = delete;
 
 	// to start work from here
-	void init();	// load the initial state from the data files.
+	void init(const std::string& dataDir = DATA_DIR, const std::string& cacheFile = "");	// load the initial state
+						// from the data files, through the binary image cacheFile (dataDir/DATA_CACHE_FILE if empty)
+	void init(const Simulation& loaded);	// share the data loaded by another simulator, no disk reading.
+	void cloneState(const Simulation& live);	// take the state of a simulator sharing the same data,
+												// e.g. to try something from now on without changing it
+	void seed(unsigned int s, unsigned long long stream = 0);	// set the seed (and stream) of the random route choice
 	Report run();	// return a pointer of several doubles,
 					// including time, totalTravelTime and totalDelay.
+	Report runFluid(double dt);	// estimate the report at the end of the day with flows instead of
+								// passenger groups, in steps of dt sec. the state is not changed
+	void fitFluid();	// make the model of runFluid() from a day of run() from now (on a copy),
+						// instead of the fixed OD, kept until the routes change
 	void reset();	// reset to the initial state using the loaded data.
+	int snapshot();	// save the current state, return the handle of the snapshot
+	void restore(int handle);	// go back to the state saved by snapshot()
+	void releaseSnapshot(int handle);	// free the memory of a snapshot
 	void addPassengers(int from, int to, int num);	// add passengers right now
-	void addEvent(Event newevent) {
-		EventQueue.push(newevent);
-	}
+	void addODBatch(const double* t, const int* from, const int* to, const int* num, size_t n);	// add many NEW_OD events
+	void addEvent(Event newevent);
+	int injectIncident(int lineID, int fromStation, int toStation, double startTime, double endTime, \
+		IncidentType type);		// change the timetable of the trains on the way, return the number of trips changed
+	int closeLink(int from, int to);	// route the passengers around a link, return the number of policies changed
+	int reopenLink(int from, int to);
+	int closeStation(int station);		// route the passengers around a station
+	int reopenStation(int station);
+	void setScheduler(SchedulerType type);	// change the implementation of the event queue, the events are kept
+	void setKeyOrder(bool on);	// handle the events at the same time in the order of their keys, with
+								// the random numbers and the totals not depending on what came before
+								// (see eventBefore()), as ParallelEngine does. off by default
 	double getStationDelay(int stationID, int direction);
 	int getStationPass(int stationID, int direction);
 	int getStationWaitingPassengers(int stationID, int direction);
 	double getTime();
+	bool hasEvents();		// if there is anything left to run
+	int getTrainNum();		// the number of trains, the length of StateBuffer::trainLoad
+	int exportState(const StateBuffer& buffer, const StateLayout& layout);	// copy the whole state at once
+	const SimStats* getStats();	// the counters of run(), NULL if not compiled with SIM_STATS
 	
 
 protected:
+	friend class ParallelEngine;	// takes the lines of the state apart and puts them back
+
 	//Priority Queue for the events
-	std::priority_queue < Event, std::vector<Event, std::allocator<Event> >, EventCompare > EventQueue;
+	EventScheduler* EventQueue;
+	bool keyOrder;			// see setKeyOrder(), a part of the state like the queue
 	int totalTrainNum;		// record the total number of trains, important
 	int* time_iter;			// iterator to iterate the arrivalTime matrix
 	int* stationID_iter;	// iterator to iterate the arrivalStationID matrix
+	std::vector<Train> trains;	// the pool of the trains indexed by trainID, reused by reset(),
+								// the train handles in the events point into it
+	PassengerQueues queues;	// the passenger queues of all the stations
+	std::vector<SimState*> snapshots;	// the saved states, indexed by the snapshot handle
+	CounterRNG rng;			// random engine of this simulator, so that simulators don't share the global rand()
+	std::vector<TripEdit> incidentEdits;	// the trips before each change by injectIncident(), in order
+	std::shared_ptr<RouteTable> loadedRoutes;	// the routes before any closure, NULL if nothing is closed
+	std::shared_ptr<RoutingGraph> routingGraph;	// built when something is closed the first time
+	std::shared_ptr<RoutingIndex> routingIndex;	// the time slices, shared with the simulators sharing the data
+	int slice;				// the time slice 'time' is in, kept by updateSlice()
+	double sliceEnd;		// when the next slice starts
+	const RouteTable* sliceRoutes;	// the table and the fields (peak or off-peak) of the policy set
+	bool slicePeak;					// of the slice, used by the queries
+	std::shared_ptr<FluidModel> fluidModel;	// made by the first runFluid(), again when the routes change
+	std::vector<FluidFlows>* fluidRecord;	// [slice] where run() records the flows for fitFluid(), usually NULL
+	std::vector<std::pair<int, int>> closedLinks;
+	std::vector<int> closedStations;
+#if SIM_STATS
+	SimStats stats;			// see Stats.hpp
+#endif
+
+	void loadCSV(const std::string& dataDir);		// read the csv files into the tables
+	void initTrains();	// init the iterators and the train pool
+	TripEdit getTrip(int row) const;		// a copy of the trip of the train in the row of startTrainInfo
+	void setTrip(const TripEdit& trip);		// put a copy back into the timetable
+	void undoIncidents();					// go back to the loaded timetable
+	bool isClosed(int from, int to);		// if the link or one of the stations is closed
+	int updateRoutes();						// get the policies for the closed links and stations
+	bool loadCache(const std::string& dataDir, const std::string& file_name);	// load the tables from the binary
+																					// image, false if stale
+	void saveCache(const std::string& dataDir, const std::string& file_name);	// write the tables into it
 
 	Report report();	// return the system information
+	double amount(double value) const { return keyOrder ? exactAmount(value) : value; }	// to add to the totals
 	//Policy getPolicy(int from, int to, int lineID);	// return the optimal traveling policy
+	void updateSlice();	// find the slice of the time, after the time or the routes change
+	const RouteTable* policyRoutes(int set, bool& peak);	// the table and the fields of a policy set
+	void buildFluidModel(const std::vector<FluidFlows>* recorded = NULL);	// aggregate the fixed OD on the
+								// routes for runFluid(), or the flows recorded for each slice
+	void recordFluid(int queue, int from, int to, double walkTime, int num, bool ending);	// for fitFluid()
 	int getNextStation(int from, int to, int lineID);	// return the next station to go
 
 	//**************************************************************************************
@@ -213,5 +647,22 @@ struct Report {
 	double totalDelay;
 	int numDeparted;
 	int numArrived;
+	const SimStats* stats;	// the counters of the simulator (while it lives), NULL without SIM_STATS
 	void show();
 };
+
+// The arrays (owned by the caller) filled by exportState(), one array for each quantity so
+// each can be a numpy array as it is. The station arrays have 2 elements for each exported
+// station, [direction 0, direction 1], in the order of StateLayout. A NULL array is skipped.
+struct StateBuffer {
+	double* time;			// 1 element, the current time
+	int* queueSize;			// the passengers waiting
+	double* delay;			// the delay contributed by the direction
+	int* numPass;			// the passengers entered the queue
+	int* trainLoad;			// getTrainNum() elements, the passengers on each train by trainID
+};
+
+struct StateLayout {
+	const int* stations;	// the IDs of the stations to export, NULL for all stations by ID
+	int numStations;		// the length of 'stations'
+};
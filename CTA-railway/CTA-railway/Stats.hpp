@@ -0,0 +1,73 @@
+#pragma once
+#include <vector>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+// The counters of what happens inside Simulation::run(), to see where the time goes. They are
+// compiled in only with SIM_STATS=1 (e.g. /DSIM_STATS=1), otherwise STATS() is empty and there
+// is nothing to pay. The counters are cleared by reset() and by restore().
+#ifndef SIM_STATS
+#define SIM_STATS 0
+#endif
+
+#if SIM_STATS
+#define STATS(statement) statement
+#else
+#define STATS(statement)
+#endif
+
+#define STAT_QUEUE_BUCKETS 16	// queue length 0, 1, 2-3, 4-7, ..., 2^14 and more
+#define STAT_CYCLE_SAMPLING 64	// time one event of every 64, reading the clock costs as much as a small
+								// handler. the cycles are scaled up, so they are an estimate
+
+// the order of the counters given by getStats(), the first three are indexed by EventType
+enum StatCounter {
+	STAT_ARRIVAL_EVENTS,
+	STAT_SUSPEND_EVENTS,
+	STAT_NEW_OD_EVENTS,
+	STAT_ARRIVAL_CYCLES,		// the cycles spent in the handler of each event type
+	STAT_SUSPEND_CYCLES,
+	STAT_NEW_OD_CYCLES,
+	STAT_TRANSFER_ODS,			// NEW_OD made for the passengers getting off to transfer
+	STAT_TRANSFER_REPUSHES,		// NEW_OD pushed again after walking to the next line
+	STAT_HEAP_HIGH_WATER,		// the most events in the queue at once, since reset()
+	STAT_REAL_STATION_WALKS,	// getRealStation() calls not answered by the precomputed closure
+	STAT_REAL_STATION_STEPS,	// the transfer stations walked through by them
+	NUM_STAT_COUNTERS
+};
+
+struct SimStats {
+	long long counters[NUM_STAT_COUNTERS];
+	std::vector<long long> queueHistogram;	// [station * 2 + direction][bucket], the queue length
+											// seen by each arriving train
+	void clear(int numStations);
+	void show() const;
+};
+
+// the bucket of a queue length, 1 + log2
+inline int queueBucket(int length) {
+	if (length <= 0)
+		return 0;
+#if defined(_MSC_VER)
+	unsigned long bit;
+	_BitScanReverse(&bit, (unsigned long)length);
+	int bucket = int(bit) + 1;
+#else
+	int bucket = 32 - __builtin_clz((unsigned int)length);
+#endif
+	return (bucket < STAT_QUEUE_BUCKETS) ? bucket : STAT_QUEUE_BUCKETS - 1;
+}
+
+// the time stamp counter, or the nanoseconds where there is none
+inline long long readCycles() {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+	return (long long)__rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
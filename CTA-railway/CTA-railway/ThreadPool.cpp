@@ -0,0 +1,98 @@
+#include "ThreadPool.hpp"
+
+ThreadPool::ThreadPool(int numThreads) : job(NULL), jobSize(0), nextIndex(0), numWorking(0), \
+	generation(0), stopping(false) {
+	if (numThreads <= 0)
+		numThreads = std::thread::hardware_concurrency();
+	// the calling thread also works, so one less worker is needed
+	for (int i = 1; i < numThreads; i++)
+		workers.push_back(std::thread(&ThreadPool::work, this));
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		stopping = true;
+	}
+	newJob.notify_all();
+	for (auto iter = workers.begin(); iter != workers.end(); iter++)
+		iter->join();
+}
+
+int ThreadPool::size() {
+	return int(workers.size()) + 1;
+}
+
+void ThreadPool::parallelFor(int n, const std::function<void(int)>& job) {
+	if (n <= 0)
+		return;
+	if (workers.empty() || n == 1) {
+		for (int i = 0; i < n; i++)
+			job(i);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		this->job = &job;
+		jobSize = n;
+		nextIndex = 0;
+		numWorking = int(workers.size());
+		generation++;
+	}
+	newJob.notify_all();
+
+	runIndices();
+
+	// wait until the workers finish their last index
+	std::exception_ptr failed;
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+		jobDone.wait(lock, [this] { return numWorking == 0; });
+		this->job = NULL;
+		failed = error;
+		error = NULL;
+	}
+	if (failed)
+		std::rethrow_exception(failed);
+}
+
+void ThreadPool::work() {
+	unsigned int lastGeneration = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			newJob.wait(lock, [this, lastGeneration] { return stopping || generation != lastGeneration; });
+			if (stopping)
+				return;
+			lastGeneration = generation;
+		}
+
+		runIndices();
+
+		bool last;
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			numWorking--;
+			last = (numWorking == 0);
+		}
+		if (last)
+			jobDone.notify_one();
+	}
+}
+
+void ThreadPool::runIndices() {
+	int i;
+	while ((i = nextIndex.fetch_add(1)) < jobSize) {
+		try {
+			(*job)(i);
+		}
+		catch (...) {
+			// an exception can't leave the thread, keep it for parallelFor()
+			std::lock_guard<std::mutex> lock(mtx);
+			if (!error)
+				error = std::current_exception();
+			nextIndex = jobSize;
+		}
+	}
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed group of worker threads to run the same job on many indices, e.g. to
+// run several simulators at the same time. The threads are created once and wait
+// for the next job, so that a short job doesn't pay for creating the threads.
+class ThreadPool {
+public:
+	ThreadPool(int numThreads = 0);	// 0 means one thread per core
+	~ThreadPool();
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// call job(0), job(1), ..., job(n - 1) on the workers and the calling thread,
+	// return when all of them are done. Only one parallelFor can run at a time.
+	// if a job throws, the indices not started yet are skipped and the first
+	// exception is thrown again here, in the calling thread (as std::async does)
+	void parallelFor(int n, const std::function<void(int)>& job);
+	int size();		// number of threads working on a job, including the calling thread
+
+private:
+	std::vector<std::thread> workers;
+	std::mutex mtx;
+	std::condition_variable newJob;		// notify the workers when there is a new job
+	std::condition_variable jobDone;	// notify the caller when all the workers are done
+
+	const std::function<void(int)>* job;	// the current job
+	int jobSize;				// the number of indices of the current job
+	std::atomic<int> nextIndex;	// the next index to be taken by a thread
+	int numWorking;				// the number of workers still on the current job
+	unsigned int generation;	// increased for every new job, so that a worker won't run a job twice
+	bool stopping;
+	std::exception_ptr error;	// the first exception of the current job
+
+	void work();				// the loop of the workers
+	void runIndices();			// take the indices one by one until there is none left
+};
@@ -1,38 +1,283 @@
 #include "Simulation.hpp"
+#include "ThreadPool.hpp"
+#include "Replications.hpp"
+#include "Rollouts.hpp"
+#include "ParallelEngine.hpp"
+#include "Fluid.hpp"
+#include "RouteBuilder.hpp"
+#include "Benchmark.hpp"
+#include "Generator.hpp"
+#include "EventLog.hpp"
+#include "SelfTest.hpp"
 #include "util.hpp"
+#include <chrono>
+
+// run one day, or with "--replications R [seed] [threads]" run R replications on all the cores.
+// "--build-routes <links.csv> <out_dir> [--offpeak <links.csv>] [--threads N]" builds the
+// routing tables of the data in 'out_dir' and exits, see buildRoutes().
+// "--benchmark [--out file.json] [--repeats N] [data dirs...]" measures the speed on the data sets,
+// see Benchmark.hpp.
+// "--generate <out_dir> [field=value ...]" writes a synthetic data set, the fields of NetworkSpec
+// e.g. layout=radial numLines=12 numODs=300000, see Generator.hpp.
+// "--parallel [partitions] [threads]" runs the day with the lines on several threads, and with run() in
+// key order on a copy to compare the time and the report, see ParallelEngine.hpp.
+// "--fluid [dt]" estimates the day with the fluid approximation fitted on the day (only a
+// single-digit speedup over run()), "--calibrate-fluid [dt ...]" compares it with the discrete
+// events for each step on days it was not fitted on, see Fluid.hpp.
+// "--self-test" runs the checks of SelfTest.hpp on the data, the exit code is the number of failures.
+// "--log <file>" before any of them writes the diagnostics into a binary log instead of the
+// console, "--read-log <file> [--csv]" prints such a log, see EventLog.hpp
+int main(int argc, char* argv[]) {
+	if (argc > 2 && string(argv[1]) == "--read-log") {
+		bool csv = (argc > 3 && string(argv[3]) == "--csv");
+		if (readLog(argv[2], cout, csv) < 0) {
+			cout << argv[2] << " is not a log file!\n";
+			return 1;
+		}
+		return 0;
+	}
+
+	if (argc > 2 && string(argv[1]) == "--log") {
+		if (!eventLog().open(argv[2])) {
+			cout << "can't write the log " << argv[2] << "\n";
+			return 1;
+		}
+		// go on with the rest of the arguments
+		argv[2] = argv[0];
+		argv += 2;
+		argc -= 2;
+	}
+
+	if (argc > 2 && string(argv[1]) == "--generate") {
+		NetworkSpec spec;
+		for (int i = 3; i < argc; i++) {
+			string arg = argv[i];
+			size_t pos = arg.find('=');
+			if (pos == string::npos || !spec.set(arg.substr(0, pos), arg.substr(pos + 1))) {
+				cout << "unknown parameter " << arg << "\n";
+				return 1;
+			}
+		}
+		return (generateNetwork(spec, argv[2]) > 0) ? 0 : 1;
+	}
+
+	if (argc > 1 && string(argv[1]) == "--benchmark") {
+		string out_name = "benchmark.json";
+		int repeats = 3;
+		std::vector<string> dataDirs;
+		for (int i = 2; i < argc; i++) {
+			if (string(argv[i]) == "--out" && i + 1 < argc)
+				out_name = argv[++i];
+			else if (string(argv[i]) == "--repeats" && i + 1 < argc)
+				repeats = atoi(argv[++i]);
+			else
+				dataDirs.push_back(argv[i]);
+		}
+		if (dataDirs.empty())
+			dataDirs = { DATA_DIR, "../../data_with_bus", "simple_data" };	// from the project directory
+
+		std::vector<BenchmarkResult> results;
+		for (auto iter = dataDirs.cbegin(); iter != dataDirs.cend(); iter++) {
+			BenchmarkResult result = runBenchmark(*iter, repeats);
+			if (result.error.empty())
+				cout << *iter << ": " << result.eventsPerSecond << " events/s, step p99 " << result.stepP99 * 1000.0 << " ms\n";
+			else
+				cout << *iter << ": " << result.error << "\n";
+			results.push_back(result);
+		}
+		eventLog().close();
+		if (!writeBenchmark(out_name, results)) {
+			cout << "can't write " << out_name << "\n";
+			return 1;
+		}
+		return 0;
+	}
+
+	if (argc > 3 && string(argv[1]) == "--build-routes") {
+		string offpeakLinkFile;
+		int numThreads = 0;
+		for (int i = 4; i + 1 < argc; i += 2) {
+			if (string(argv[i]) == "--offpeak")
+				offpeakLinkFile = argv[i + 1];
+			else if (string(argv[i]) == "--threads")
+				numThreads = atoi(argv[i + 1]);
+		}
+		return buildRoutes(argv[2], offpeakLinkFile, argv[3], numThreads) ? 0 : 1;
+	}
 
-int main() {
 	Simulation myFirstSim;
 	myFirstSim.init();
 	cout << "Simulation initialized!\n" << "Start running...\n";
 
+	if (argc > 2 && string(argv[1]) == "--replications") {
+		int numReplications = atoi(argv[2]);
+		unsigned int seed = (argc > 3) ? (unsigned int)strtoul(argv[3], NULL, 10) : 0;
+		int numThreads = (argc > 4) ? atoi(argv[4]) : 0;
+		ReplicationReport report = runReplications(myFirstSim, numReplications, seed, numThreads);
+		eventLog().close();
+		report.show();
+		return 0;
+	}
+
+	if (argc > 1 && string(argv[1]) == "--self-test") {
+		int failures = runSelfTests(myFirstSim);
+		eventLog().close();
+		cout << failures << " check(s) failed\n";
+		return failures;
+	}
+
+	if (argc > 1 && string(argv[1]) == "--parallel") {
+		int numPartitions = (argc > 2) ? atoi(argv[2]) : 0;
+		int numThreads = (argc > 3) ? atoi(argv[3]) : 0;
+		myFirstSim.setKeyOrder(true);
+		Simulation sequential;
+		sequential.init(myFirstSim);
+		sequential.cloneState(myFirstSim);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		Report expected = sequential.run();
+		double runSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		ParallelEngine engine(numThreads);
+		start = std::chrono::steady_clock::now();
+		Report report = engine.run(myFirstSim, numPartitions);
+		double parallelSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		eventLog().close();
+		cout << engine.partitionCount() << " partitions, lookahead " << engine.lookahead() << " sec, " \
+			<< engine.numWindows << " windows, " << engine.numMessages << " transfers between them\n";
+		cout << "run() / parallel (ms):\t" << runSeconds * 1000.0 << " / " << parallelSeconds * 1000.0 \
+			<< " on " << engine.threadCount() << " threads (the first run makes the copies of the simulator)\n";
+		bool same = report.totalTravelTime == expected.totalTravelTime && report.totalDelay == expected.totalDelay && \
+			report.numDeparted == expected.numDeparted && report.numArrived == expected.numArrived;
+		cout << (same ? "the same report as run() in key order\n" : "NOT the same report as run() in key order!\n");
+		report.show();
+		return same ? 0 : 1;
+	}
+
+	if (argc > 1 && string(argv[1]) == "--fluid") {
+		double dt = (argc > 2) ? atof(argv[2]) : FLUID_DEFAULT_DT;
+		myFirstSim.fitFluid();
+		Report report = myFirstSim.runFluid(dt);
+		eventLog().close();
+		report.show();
+		return 0;
+	}
+
+	if (argc > 1 && string(argv[1]) == "--calibrate-fluid") {
+		std::vector<double> steps;
+		for (int i = 2; i < argc; i++)
+			steps.push_back(atof(argv[i]));
+		if (steps.empty())
+			steps = { 10.0, 30.0, FLUID_DEFAULT_DT, 120.0, 300.0 };
+		for (auto iter = steps.cbegin(); iter != steps.cend(); iter++) {
+			FluidCalibration calibration = calibrateFluid(myFirstSim, *iter);
+			eventLog().flush();		// the diagnostics of run() before the table
+			calibration.show();
+		}
+		eventLog().close();
+		return 0;
+	}
+
 	Report report = myFirstSim.run();
+	eventLog().close();		// write what's left before the report
 	report.show();
 	return 0;
 }
 
 // python API
+// No exception may go across the C ABI (ctypes can't catch it, the process would be terminated),
+// so each export catches what the simulator throws: the exports return SIM_ERROR (-1, or -1.0)
+// then, or false if they return a bool, and lastErrorSim() gives the message. The exports
+// which returned nothing return 0 if they worked.
+#define SIM_ERROR -1
+
+static thread_local std::string lastError;	// of the calls of this thread
+
+template <typename T, typename Body>
+static T guarded(T failed, Body body) {
+	try {
+		return body();
+	}
+	catch (const char* msg) {
+		lastError = msg;
+	}
+	catch (const std::exception& e) {
+		lastError = e.what();
+	}
+	catch (...) {
+		lastError = "unknown error";
+	}
+	cout << "simulator error: " << lastError << "\n";
+	return failed;
+}
+
+// the same for a body which returns nothing
+template <typename Body>
+static int guardedCall(Body body) {
+	return guarded(SIM_ERROR, [&body]() {
+		body();
+		return 0;
+	});
+}
+
 extern "C" {
 	Simulation Sim;
 	Report report;
 
+	bool dataLoaded = false;	// if 'Sim' has loaded the data, the other simulators share its data
+
+	// the message of the last export of this thread which failed, empty if none has
+	_declspec(dllexport) const char* lastErrorSim() {
+		return lastError.c_str();
+	}
+
 	// initialize the simulator, just need once
-	_declspec(dllexport) void initSim() {
-		Sim.init();
+	_declspec(dllexport) int initSim() {
+		return guardedCall([]() {
+			Sim.init();
+			dataLoaded = true;
+		});
 	}
 
 	// reset the simulator
-	_declspec(dllexport) void resetSim() {
-		Sim.reset();
+	_declspec(dllexport) int resetSim() {
+		return guardedCall([]() { Sim.reset(); });
+	}
+
+	// choose the implementation of the event queue: 0 binary heap, 1 4-ary heap, 2 calendar queue
+	_declspec(dllexport) int setSchedulerSim(int type) {
+		return guardedCall([type]() { Sim.setScheduler(SchedulerType(type)); });
+	}
+
+	// save the current state of the simulator, return the handle of the snapshot
+	_declspec(dllexport) int snapshotSim() {
+		return guarded(SIM_ERROR, []() { return Sim.snapshot(); });
+	}
+
+	// go back to a saved state, e.g. the start of the control period,
+	// instead of reset and run from the beginning again
+	_declspec(dllexport) int restoreSim(int handle) {
+		return guardedCall([handle]() { Sim.restore(handle); });
+	}
+
+	_declspec(dllexport) int releaseSnapshotSim(int handle) {
+		return guardedCall([handle]() { Sim.releaseSnapshot(handle); });
+	}
+
+	// set the random route choice to the stream (seed, stream), e.g. one stream for each
+	// episode restored from the same snapshot
+	_declspec(dllexport) int seedSim(unsigned int seed, unsigned long long stream) {
+		return guardedCall([seed, stream]() { Sim.seed(seed, stream); });
 	}
 
 	// start the simulator, and it will stop at the suspend point
 	// the user set in the simulation events or when the simulation
 	// reaches its end.
 	// the report data will be printed.
-	_declspec(dllexport) void runSim() {
-		report = Sim.run();
-		//report.show();
+	_declspec(dllexport) int runSim() {
+		return guardedCall([]() {
+			report = Sim.run();
+			//report.show();
+		});
 	}
 
 	// functions to get the data from last report point when the
@@ -50,31 +295,463 @@ extern "C" {
 	}
 
 	_declspec(dllexport) double getStationDelay(int stationID, int direction) {
-		return Sim.getStationDelay(stationID, direction);
+		return guarded(double(SIM_ERROR), [=]() { return Sim.getStationDelay(stationID, direction); });
 	}
 
 	_declspec(dllexport) int getStationPass(int stationID, int direction) {
-		return Sim.getStationPass(stationID, direction);
+		return guarded(SIM_ERROR, [=]() { return Sim.getStationPass(stationID, direction); });
 	}
 
 	_declspec(dllexport) int getStationWaitingPassengers(int stationID, int direction) {
-		return Sim.getStationWaitingPassengers(stationID, direction);
+		return guarded(SIM_ERROR, [=]() { return Sim.getStationWaitingPassengers(stationID, direction); });
 	}
 
-	_declspec(dllexport) void addSuspend(double suspendTime) {
-		Event newSuspend(suspendTime, SUSPEND);
-		Sim.addEvent(newSuspend);
+	_declspec(dllexport) int addSuspend(double suspendTime) {
+		return guardedCall([suspendTime]() {
+			Event newSuspend(suspendTime, SUSPEND);
+			Sim.addEvent(newSuspend);
+		});
 	}
 
 	_declspec(dllexport) double getTime() {
 		return Sim.getTime();
 	}
 
-	_declspec(dllexport) void addOD(double time, int from, int to, int num) {
-		Event newODEvent(time, NEW_OD, false);
-		newODEvent.from = from;
-		newODEvent.to = to;
-		newODEvent.num = num;
-		Sim.addEvent(newODEvent);
+	_declspec(dllexport) int addOD(double time, int from, int to, int num) {
+		return guardedCall([=]() {
+			Event newODEvent(time, NEW_OD, false);
+			newODEvent.from = from;
+			newODEvent.to = to;
+			newODEvent.num = num;
+			Sim.addEvent(newODEvent);
+		});
+	}
+
+	// block a part of a line for a while, type 0 delays the trains and 1 short-turns them,
+	// return the number of trips changed. reset() goes back to the loaded timetable
+	_declspec(dllexport) int injectIncidentSim(int lineID, int fromStation, int toStation, double startTime, \
+		double endTime, int type) {
+		return guarded(SIM_ERROR, [=]() {
+			return Sim.injectIncident(lineID, fromStation, toStation, startTime, endTime, IncidentType(type));
+		});
+	}
+
+	// close or reopen a link/station, the passengers are routed around the closed ones from now on,
+	// return the number of policies changed from the loaded ones. reset() reopens everything
+	_declspec(dllexport) int closeLinkSim(int from, int to) {
+		return guarded(SIM_ERROR, [=]() { return Sim.closeLink(from, to); });
+	}
+
+	_declspec(dllexport) int reopenLinkSim(int from, int to) {
+		return guarded(SIM_ERROR, [=]() { return Sim.reopenLink(from, to); });
+	}
+
+	_declspec(dllexport) int closeStationSim(int station) {
+		return guarded(SIM_ERROR, [=]() { return Sim.closeStation(station); });
+	}
+
+	_declspec(dllexport) int reopenStationSim(int station) {
+		return guarded(SIM_ERROR, [=]() { return Sim.reopenStation(station); });
+	}
+
+	_declspec(dllexport) int getTrainNum() {
+		return Sim.getTrainNum();
+	}
+
+	// fill the caller's arrays with the state of the stations in the layout and all the trains,
+	// return the number of stations exported
+	_declspec(dllexport) int exportState(const StateBuffer* buffer, const StateLayout* layout) {
+		return guarded(SIM_ERROR, [=]() { return Sim.exportState(*buffer, *layout); });
+	}
+
+	// add n OD groups with one call, the arrays are owned by the caller
+	_declspec(dllexport) int addODBatch(const double* t, const int* from, const int* to, const int* num, size_t n) {
+		return guardedCall([=]() { Sim.addODBatch(t, from, to, num, n); });
+	}
+}
+// python API for several simulators in one process
+// Each simulator is referred to by the handle returned from createSim(). They share the
+// data loaded by 'Sim' (loaded when the first one is created, if initSim() is not called),
+// and have their own state, random engine and report, so they can run at the same time.
+// A handle which doesn't exist is an error like the others (getInstance() throws)
+extern "C" {
+	struct SimInstance {
+		Simulation sim;
+		Report report = Report();
+	};
+	std::vector<SimInstance*> instances;	// indexed by the handle, NULL if destroyed
+	ThreadPool* pool = NULL;				// the threads to run the simulators, see stepMany()
+	RolloutEvaluator* evaluator = NULL;		// the threads and copies for the what-if rollouts
+	ParallelEngine* engine = NULL;			// the threads and partitions of runParallelSim()
+
+	static SimInstance* getInstance(int handle) {
+		if (handle < 0 || handle >= int(instances.size()) || instances[handle] == NULL) {
+			cout << "simulator " << handle << " not existing!\n";
+			throw "Invalid simulator handle!";
+		}
+		return instances[handle];
+	}
+
+	// create a new simulator with the given random seed, return its handle
+	_declspec(dllexport) int createSim(unsigned int seed) {
+		return guarded(SIM_ERROR, [seed]() {
+			if (!dataLoaded) {
+				Sim.init();
+				dataLoaded = true;
+			}
+			SimInstance* instance = new SimInstance;
+			try {
+				instance->sim.init(Sim);
+			}
+			catch (...) {
+				delete instance;
+				throw;
+			}
+			instance->sim.seed(seed);
+
+			// reuse the handle of a destroyed simulator if possible
+			for (int i = 0; i < int(instances.size()); i++) {
+				if (instances[i] == NULL) {
+					instances[i] = instance;
+					return i;
+				}
+			}
+			instances.push_back(instance);
+			return int(instances.size()) - 1;
+		});
+	}
+
+	_declspec(dllexport) int destroySim(int handle) {
+		return guardedCall([handle]() {
+			delete getInstance(handle);
+			instances[handle] = NULL;
+		});
+	}
+
+	// set the number of threads used by stepMany(), 0 means one thread per core
+	_declspec(dllexport) int setNumThreads(int numThreads) {
+		return guardedCall([numThreads]() {
+			delete pool;
+			pool = new ThreadPool(numThreads);
+			delete evaluator;
+			evaluator = new RolloutEvaluator(numThreads);
+			delete engine;
+			engine = new ParallelEngine(numThreads);
+		});
+	}
+
+	_declspec(dllexport) int resetSimOf(int handle) {
+		return guardedCall([handle]() { getInstance(handle)->sim.reset(); });
+	}
+
+	_declspec(dllexport) int runSimOf(int handle) {
+		return guardedCall([handle]() {
+			SimInstance* instance = getInstance(handle);
+			instance->report = instance->sim.run();
+		});
+	}
+
+	// run the simulators to their next suspend point (or the end) at the same time. return the
+	// number of them which failed, SIM_ERROR if a handle doesn't exist (then none is run).
+	// lastErrorSim() gives the message of the first one which failed
+	_declspec(dllexport) int stepMany(const int* handles, int n) {
+		return guarded(SIM_ERROR, [handles, n]() {
+			std::vector<SimInstance*> batch;
+			for (int i = 0; i < n; i++)
+				batch.push_back(getInstance(handles[i]));
+			if (pool == NULL)
+				pool = new ThreadPool();
+
+			// an exception can't go across the threads, each one keeps its message here
+			std::vector<std::string> errors(n);
+			pool->parallelFor(n, [&batch, &errors](int i) {
+				try {
+					batch[i]->report = batch[i]->sim.run();
+				}
+				catch (const char* msg) {
+					errors[i] = msg;
+				}
+				catch (const std::exception& e) {
+					errors[i] = e.what();
+				}
+				catch (...) {
+					errors[i] = "unknown error";
+				}
+			});
+			int numFailed = 0;
+			for (int i = 0; i < n; i++) {
+				if (errors[i].empty())
+					continue;
+				cout << "simulator " << handles[i] << " error: " << errors[i] << "\n";
+				if (numFailed == 0)
+					lastError = errors[i];
+				numFailed++;
+			}
+			return numFailed;
+		});
+	}
+
+	_declspec(dllexport) int SimIsFinishedOf(int handle) {
+		return guarded(SIM_ERROR, [handle]() { return getInstance(handle)->report.isFinished ? 1 : 0; });
+	}
+
+	_declspec(dllexport) double getTotalTravelTimeOf(int handle) {
+		return guarded(double(SIM_ERROR), [handle]() { return getInstance(handle)->report.totalTravelTime; });
+	}
+
+	_declspec(dllexport) double getTotalDelayOf(int handle) {
+		return guarded(double(SIM_ERROR), [handle]() { return getInstance(handle)->report.totalDelay; });
+	}
+
+	_declspec(dllexport) double getTimeOf(int handle) {
+		return guarded(double(SIM_ERROR), [handle]() { return getInstance(handle)->sim.getTime(); });
+	}
+
+	// run the day 'numReplications' times with the random streams (seed, 0), (seed, 1)...
+	// 'summary' gets [mean, std, ci95] of totalTravelTime, totalDelay, numDeparted and numArrived
+	// (12 doubles), 'results' gets the same 4 values of each replication if not NULL.
+	// return the number of the replications that finish
+	_declspec(dllexport) int runReplicationsSim(int numReplications, unsigned int seed, int numThreads, \
+		double* summary, double* results) {
+		return guarded(SIM_ERROR, [=]() {
+			if (!dataLoaded) {
+				Sim.init();
+				dataLoaded = true;
+			}
+			std::vector<Report> reports;
+			ReplicationReport report = runReplications(Sim, numReplications, seed, numThreads, ScenarioSetup(), &reports);
+
+			Statistic* stats[4] = { &report.totalTravelTime, &report.totalDelay, &report.numDeparted, &report.numArrived };
+			for (int i = 0; i < 4; i++) {
+				summary[3 * i] = stats[i]->mean;
+				summary[3 * i + 1] = stats[i]->stdDev;
+				summary[3 * i + 2] = stats[i]->ci95;
+			}
+			if (results != NULL) {
+				for (int r = 0; r < int(reports.size()); r++) {
+					results[4 * r] = reports[r].totalTravelTime;
+					results[4 * r + 1] = reports[r].totalDelay;
+					results[4 * r + 2] = reports[r].numDeparted;
+					results[4 * r + 3] = reports[r].numArrived;
+				}
+			}
+			return report.numFinished;
+		});
+	}
+
+	// copy the counters of run() (NUM_STAT_COUNTERS, in the order of StatCounter) and, if not NULL,
+	// the queue length histograms (numStations * 2 * STAT_QUEUE_BUCKETS). return the number of
+	// counters, 0 if the simulator is not compiled with SIM_STATS
+	static int copyStats(const SimStats* stats, long long* counters, long long* histogram) {
+		if (stats == NULL)
+			return 0;
+		std::copy(stats->counters, stats->counters + NUM_STAT_COUNTERS, counters);
+		if (histogram != NULL)
+			std::copy(stats->queueHistogram.begin(), stats->queueHistogram.end(), histogram);
+		return NUM_STAT_COUNTERS;
+	}
+
+	_declspec(dllexport) int getStats(long long* counters, long long* histogram) {
+		return guarded(SIM_ERROR, [=]() { return copyStats(Sim.getStats(), counters, histogram); });
 	}
-}
\ No newline at end of file
+
+	// write the diagnostics of all the simulators into a binary log (see EventLog.hpp) instead of
+	// the console. return false if the file can't be written
+	_declspec(dllexport) bool openLogSim(const char* file_name) {
+		return guarded(false, [file_name]() { return eventLog().open(file_name); });
+	}
+
+	// write all the records logged so far
+	_declspec(dllexport) int flushLogSim() {
+		return guardedCall([]() { eventLog().flush(); });
+	}
+
+	// close the log file and go back to the console, should be called before the dll is unloaded
+	_declspec(dllexport) int closeLogSim() {
+		return guardedCall([]() { eventLog().close(); });
+	}
+
+	// the records lost because the log was full
+	_declspec(dllexport) long long getLogDropped() {
+		return eventLog().dropped();
+	}
+
+	// build policy.csv, policy2.csv and policy_num.csv in 'outDir' from the links of the network,
+	// 'offpeakLinkFile' can be NULL or empty to use the same links for both sets. 'numThreads' <= 0
+	// uses all the cores. the data should be loaded (again) after the tables are built
+	_declspec(dllexport) bool buildRoutesSim(const char* linkFile, const char* offpeakLinkFile, const char* outDir, \
+		int numThreads) {
+		return guarded(false, [=]() {
+			return buildRoutes(linkFile, (offpeakLinkFile != NULL) ? offpeakLinkFile : "", outDir, numThreads);
+		});
+	}
+
+	_declspec(dllexport) int addSuspendOf(int handle, double suspendTime) {
+		return guardedCall([=]() {
+			Event newSuspend(suspendTime, SUSPEND);
+			getInstance(handle)->sim.addEvent(newSuspend);
+		});
+	}
+
+	_declspec(dllexport) int addODOf(int handle, double time, int from, int to, int num) {
+		return guardedCall([=]() {
+			Event newODEvent(time, NEW_OD, false);
+			newODEvent.from = from;
+			newODEvent.to = to;
+			newODEvent.num = num;
+			getInstance(handle)->sim.addEvent(newODEvent);
+		});
+	}
+
+	_declspec(dllexport) int injectIncidentOf(int handle, int lineID, int fromStation, int toStation, double startTime, \
+		double endTime, int type) {
+		return guarded(SIM_ERROR, [=]() {
+			return getInstance(handle)->sim.injectIncident(lineID, fromStation, toStation, startTime, endTime, IncidentType(type));
+		});
+	}
+
+	_declspec(dllexport) int closeLinkOf(int handle, int from, int to) {
+		return guarded(SIM_ERROR, [=]() { return getInstance(handle)->sim.closeLink(from, to); });
+	}
+
+	_declspec(dllexport) int reopenLinkOf(int handle, int from, int to) {
+		return guarded(SIM_ERROR, [=]() { return getInstance(handle)->sim.reopenLink(from, to); });
+	}
+
+	_declspec(dllexport) int closeStationOf(int handle, int station) {
+		return guarded(SIM_ERROR, [=]() { return getInstance(handle)->sim.closeStation(station); });
+	}
+
+	_declspec(dllexport) int reopenStationOf(int handle, int station) {
+		return guarded(SIM_ERROR, [=]() { return getInstance(handle)->sim.reopenStation(station); });
+	}
+
+	_declspec(dllexport) int exportStateOf(int handle, const StateBuffer* buffer, const StateLayout* layout) {
+		return guarded(SIM_ERROR, [=]() { return getInstance(handle)->sim.exportState(*buffer, *layout); });
+	}
+
+	_declspec(dllexport) int getStatsOf(int handle, long long* counters, long long* histogram) {
+		return guarded(SIM_ERROR, [=]() { return copyStats(getInstance(handle)->sim.getStats(), counters, histogram); });
+	}
+
+	_declspec(dllexport) int addODBatchOf(int handle, const double* t, const int* from, const int* to, const int* num, size_t n) {
+		return guardedCall([=]() { getInstance(handle)->sim.addODBatch(t, from, to, num, n); });
+	}
+
+	// run 'numCandidates' candidate actions from the state of 'live' for 'horizon' sec at the same
+	// time, 'live' is not changed. the passengers let in by candidate k are the groups
+	// offsets[k] .. offsets[k + 1] - 1 of (t, from, to, num). 'results' gets the increase of
+	// totalTravelTime, totalDelay, numDeparted and numArrived of each candidate (4 doubles each).
+	// return the number of candidates run to the horizon
+	static int evaluateCandidatesOn(const Simulation& live, int numCandidates, const int* offsets, const double* t, \
+		const int* from, const int* to, const int* num, double horizon, double* results) {
+		std::vector<CandidateAction> actions(numCandidates > 0 ? numCandidates : 0);
+		for (int k = 0; k < numCandidates; k++) {
+			CandidateAction& action = actions[k];
+			action.time.assign(t + offsets[k], t + offsets[k + 1]);
+			action.from.assign(from + offsets[k], from + offsets[k + 1]);
+			action.to.assign(to + offsets[k], to + offsets[k + 1]);
+			action.num.assign(num + offsets[k], num + offsets[k + 1]);
+		}
+		if (evaluator == NULL)
+			evaluator = new RolloutEvaluator();
+
+		std::vector<Report> deltas;
+		int numReached = evaluator->evaluateCandidates(live, actions, horizon, deltas);
+		for (int k = 0; k < int(deltas.size()); k++) {
+			results[4 * k] = deltas[k].totalTravelTime;
+			results[4 * k + 1] = deltas[k].totalDelay;
+			results[4 * k + 2] = deltas[k].numDeparted;
+			results[4 * k + 3] = deltas[k].numArrived;
+		}
+		return numReached;
+	}
+
+	_declspec(dllexport) int evaluateCandidatesSim(int numCandidates, const int* offsets, const double* t, const int* from, \
+		const int* to, const int* num, double horizon, double* results) {
+		return guarded(SIM_ERROR, [=]() {
+			return evaluateCandidatesOn(Sim, numCandidates, offsets, t, from, to, num, horizon, results);
+		});
+	}
+
+	_declspec(dllexport) int evaluateCandidatesOf(int handle, int numCandidates, const int* offsets, const double* t, \
+		const int* from, const int* to, const int* num, double horizon, double* results) {
+		return guarded(SIM_ERROR, [=]() {
+			return evaluateCandidatesOn(getInstance(handle)->sim, numCandidates, offsets, t, from, to, num, horizon, results);
+		});
+	}
+
+	// run to the next suspend point (or the end) like runSim() in key order, with the lines on the threads
+	// of setNumThreads(). numPartitions <= 0 gives each group of lines its own partition
+	_declspec(dllexport) int runParallelSim(int numPartitions) {
+		return guardedCall([numPartitions]() {
+			if (engine == NULL)
+				engine = new ParallelEngine();
+			report = engine->run(Sim, numPartitions);
+		});
+	}
+
+	_declspec(dllexport) int runParallelOf(int handle, int numPartitions) {
+		return guardedCall([=]() {
+			SimInstance* instance = getInstance(handle);
+			if (engine == NULL)
+				engine = new ParallelEngine();
+			instance->report = engine->run(instance->sim, numPartitions);
+		});
+	}
+
+	// estimate the report at the end of the day with the fluid approximation in steps of dt sec,
+	// the simulator is not changed. SimIsFinished(), getTotalTravelTime()... give the estimate
+	_declspec(dllexport) int runFluidSim(double dt) {
+		return guardedCall([dt]() { report = Sim.runFluid(dt); });
+	}
+
+	_declspec(dllexport) int runFluidOf(int handle, double dt) {
+		return guardedCall([=]() {
+			SimInstance* instance = getInstance(handle);
+			instance->report = instance->sim.runFluid(dt);
+		});
+	}
+
+	// fit the fluid approximation on a day of run() from now (the simulator is not changed), used
+	// by runFluidSim() until the routes change. without it the fixed OD is traced, see Fluid.hpp
+	_declspec(dllexport) int fitFluidSim() {
+		return guardedCall([]() { Sim.fitFluid(); });
+	}
+
+	_declspec(dllexport) int fitFluidOf(int handle) {
+		return guardedCall([handle]() { getInstance(handle)->sim.fitFluid(); });
+	}
+
+	// fit runFluid(dt) on a day of the loaded data and compare it with run() on days it was not
+	// fitted on. 'results' gets the relative errors of totalTravelTime, totalDelay, numDeparted and
+	// numArrived on a busier day, the same on the day with a short turn (0 if there is none to
+	// make), and the seconds of a day of run(), of runFluid() and of fitting the model (11 doubles)
+	_declspec(dllexport) int calibrateFluidSim(double dt, double* results) {
+		return guardedCall([=]() {
+			if (!dataLoaded) {
+				Sim.init();
+				dataLoaded = true;
+			}
+			FluidCalibration calibration = calibrateFluid(Sim, dt);
+			const FluidErrors* errors[] = { &calibration.errors, &calibration.perturbedErrors };
+			for (int i = 0; i < 2; i++) {
+				results[i * 4] = errors[i]->travelTime;
+				results[i * 4 + 1] = errors[i]->delay;
+				results[i * 4 + 2] = errors[i]->departed;
+				results[i * 4 + 3] = errors[i]->arrived;
+			}
+			results[8] = calibration.desSeconds;
+			results[9] = calibration.fluidSeconds;
+			results[10] = calibration.modelSeconds;
+		});
+	}
+
+	_declspec(dllexport) int snapshotSimOf(int handle) {
+		return guarded(SIM_ERROR, [handle]() { return getInstance(handle)->sim.snapshot(); });
+	}
+
+	_declspec(dllexport) int restoreSimOf(int handle, int snapshot) {
+		return guardedCall([=]() { getInstance(handle)->sim.restore(snapshot); });
+	}
+}
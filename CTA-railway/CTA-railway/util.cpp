@@ -1,51 +1,109 @@
 #include "util.hpp"
+#include "DataCache.hpp"
+#include <string.h>
 
-str_mat readcsv(string file_name) {
-    str_mat mat;
-    ifstream file;
-    file.open(file_name);
-    string line;
-    bool end = false;
-
-    if (!file) {
+void readcsv(const string& file_name, const CsvRowCallback& row) {
+    // map the file instead of reading it line by line, the fields point into the mapping
+    MappedFile file;
+    if (!file.open(file_name)) {
+        long long size, mtime;
+        if (getFileStamp(file_name.c_str(), size, mtime) && size == 0)
+            return;     // an empty file can't be mapped, and has no rows
         cout << file_name << " not existing!\n";
         throw "boom!";
     }
 
-    while (!file.eof()) {
-        vector<string> newRow;
-        getline(file, line);
-        SplitString(line, newRow, ",");
-        if (!newRow.empty()) {
-            mat.push_back(newRow);
+    vector<CsvField> fields;
+    const char* pos = file.data;
+    const char* end = file.data + file.size;
+    while (pos < end) {
+        fields.clear();
+        const char* field_begin = pos;
+        while (true) {
+            char c = (pos < end) ? *pos : '\n';
+            if (c == ',' || c == '\n' || c == '\r') {
+                // prevent null string
+                if (pos > field_begin) {
+                    CsvField field = { field_begin, pos };
+                    fields.push_back(field);
+                }
+                field_begin = pos + 1;
+                if (c != ',')
+                    break;
+            }
+            pos++;
+        }
+        pos++;
+        if (!fields.empty())
+            row(fields.data(), int(fields.size()));
+    }
+}
+
+void readcsv(const string& file_name, vector<vector<int>>& mat) {
+    readcsv(file_name, [&mat](const CsvField* fields, int n) {
+        vector<int> newRow(n);
+        for (int i = 0; i < n; i++)
+            newRow[i] = fields[i].toInt();
+        mat.push_back(newRow);
+    });
+}
+
+void readcsv(const string& file_name, vector<vector<double>>& mat) {
+    readcsv(file_name, [&mat](const CsvField* fields, int n) {
+        vector<double> newRow(n);
+        for (int i = 0; i < n; i++)
+            newRow[i] = fields[i].toDouble();
+        mat.push_back(newRow);
+    });
+}
+
+int CsvField::toInt() const {
+    const char* p = begin;
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
+    // add up in 64 bits, so a value out of the int range is caught instead of wrapping around
+    long long value = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        value = value * 10 + (*p - '0');
+        if (value > 2147483648LL) {
+            cout << "int value out of range: " << string(begin, end) << "\n";
+            throw "int value out of range";
         }
+        p++;
+    }
+    if (negative)
+        value = -value;
+    if (value > 2147483647LL) {
+        cout << "int value out of range: " << string(begin, end) << "\n";
+        throw "int value out of range";
     }
-    file.close();
-    return mat;
+    return int(value);
 }
 
-void SplitString(const string& s, vector<string>& v, const string& c)
-{
-    string::size_type pos1, pos2;
-    pos2 = s.find(c);
-    pos1 = 0;
-    while (pos2 != string::npos)
-    {
-        // prevent null string
-        if(s.substr(pos1, pos2 - pos1).compare("") != 0)
-            v.push_back(s.substr(pos1, pos2 - pos1));
-        pos1 = pos2 + c.size();
-        pos2 = s.find(c, pos1);
+double CsvField::toDouble() const {
+    // the fields are not null-terminated, copy to a small buffer for strtod
+    char buffer[64];
+    size_t len = size_t(end - begin);
+    if (len >= sizeof(buffer)) {
+        cout << "double value too long: " << string(begin, end) << "\n";
+        throw "double value input error";
     }
-    if (pos1 != s.length())
-        v.push_back(s.substr(pos1));
+    memcpy(buffer, begin, len);
+    buffer[len] = '\0';
+    return strtod(buffer, NULL);
 }
 
-bool str2bool(string str) {
+bool CsvField::toBool() const {
+    string str(begin, end);
     if (str.compare("TRUE") == 0 || str.compare("true") == 0 || str.compare("True") == 0)
         return true;
     if (str.compare("FALSE") == 0 || str.compare("false") == 0 || str.compare("False") == 0)
         return false;
     cout << "bool value input error!\n";
     throw "bool value input error";
-}
\ No newline at end of file
+}
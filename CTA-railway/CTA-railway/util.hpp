@@ -1,12 +1,28 @@
+#pragma once
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <stdlib.h>
 #include <vector>
+#include <functional>
 using namespace std;
 
-typedef vector<vector<string>> str_mat;
+// a field of a csv row, pointing into the data of the file (no string is made)
+struct CsvField {
+	const char* begin;
+	const char* end;
 
-void SplitString(const string& s, vector<string>& v, const string& c);
-str_mat readcsv(string file_name);
-bool str2bool(string str);
\ No newline at end of file
+	int toInt() const;			// the same as atoi, e.g. "182.0" -> 182, but throws out of the int range
+	double toDouble() const;	// the same as atof, but throws on a field of 64 characters or more
+	bool toBool() const;		// TRUE/true/True or FALSE/false/False
+};
+
+// called for each non-empty row with its non-empty fields
+typedef function<void(const CsvField* fields, int n)> CsvRowCallback;
+
+// read a csv file in a single pass, the empty fields (e.g. the trailing commas in
+// arrivalTime.csv) and the empty rows are skipped.
+void readcsv(const string& file_name, const CsvRowCallback& row);
+// read a csv file into a matrix of numbers, one vector per row
+void readcsv(const string& file_name, vector<vector<int>>& mat);
+void readcsv(const string& file_name, vector<vector<double>>& mat);
@@ -39,6 +39,9 @@ class World(object):
         self.control_start_time = 54900 # 15:15
         self.control_end_time = 64800   # 18:00
         self.time_interval = 15 * 60    # the time interval for observation & decision
+        self.control_start_snapshot = -1    # handle of the simulator state at 15:15
+        self.seed = 0                       # the random route choices of episode e use the stream (seed, e)
+        self.episode = 0
 
         # load the Simulator
         self.Sim = WinDLL("CTA-railway.dll")
@@ -74,11 +77,20 @@ class World(object):
     def reset_world(self):
         # simulator
         self.current_time = 0
-        self.Sim.resetSim()
-        # add the suspend points
-        for t in range(self.control_start_time, self.control_end_time, self.time_interval):
-            self.Sim.addSuspend(float(t))
-        self.Sim.runSim()   # run to 15:15
+        if self.control_start_snapshot < 0:
+            self.Sim.resetSim()
+            # add the suspend points
+            for t in range(self.control_start_time, self.control_end_time, self.time_interval):
+                self.Sim.addSuspend(float(t))
+            self.Sim.runSim()   # run to 15:15
+            # the morning is the same for every episode, save it
+            self.control_start_snapshot = self.Sim.snapshotSim()
+        else:
+            # go back to 15:15 directly, the remaining suspend points are in the snapshot
+            self.Sim.restoreSim(self.control_start_snapshot)
+        # the snapshot has the random engine of 15:15 in it, give each episode its own stream
+        self.Sim.seedSim(self.seed, self.episode)
+        self.episode += 1
 
         # the cost-related data
         # self.totalTravelTime = 0.0
@@ -122,6 +134,8 @@ class World(object):
         self.panelty = 0.0
 
         # 1. let some passengers get into the station, some will leave
+        # the passengers let in are added to the simulator with one call, see addODBatch
+        batch_time, batch_O, batch_D, batch_num = [], [], [], []
         for i, action in enumerate(action_n):# 0 - 1
             action_prop = np.argmax(action)/10
             num_LetIn = int(action_prop * self.agents[i].queueSize)
@@ -129,7 +143,11 @@ class World(object):
             # put the first num_LetIn passengers into the station
             while num_LetIn > 0:
                 passenger = self.agents[i].current_queue.get()[1]
-                self.Sim.addOD(passenger.time, passenger.O, passenger.D, passenger.num) # here consider OD group will travel together
+                # here consider OD group will travel together
+                batch_time.append(passenger.time)
+                batch_O.append(passenger.O)
+                batch_D.append(passenger.D)
+                batch_num.append(passenger.num)
                 num_LetIn -= passenger.num
                 self.agents[i].queueSize -= passenger.num
 
@@ -168,6 +186,11 @@ class World(object):
                 
                 while not temp_queue.empty():
                     self.agents[i].current_queue.put(temp_queue.get())
+
+        n = len(batch_time)
+        if n > 0:
+            self.Sim.addODBatch((c_double * n)(*batch_time), (c_int * n)(*batch_O), (c_int * n)(*batch_D), \
+                (c_int * n)(*batch_num), n)
                     
         # 2. run the simulator to the next control point
         self.Sim.runSim()
@@ -226,13 +249,71 @@ class World(object):
         return False
         pass
 
+# the structures of exportState(), see StateBuffer and StateLayout in Simulation.hpp
+class StateBuffer(Structure):
+    _fields_ = [("time", POINTER(c_double)),
+                ("queueSize", POINTER(c_int)),
+                ("delay", POINTER(c_double)),
+                ("numPass", POINTER(c_int)),
+                ("trainLoad", POINTER(c_int))]
+
+class StateLayout(Structure):
+    _fields_ = [("stations", POINTER(c_int)),
+                ("numStations", c_int)]
+
+class StateExport(object):
+    """
+    numpy arrays filled by one exportState() call, for the given stations (all if None).
+    the station arrays have the shape (num of stations, 2 directions)
+    """
+    def __init__(self, dll, num_stations, stations=None):
+        self.dll = dll
+        if stations is not None:
+            self.stations = np.ascontiguousarray(stations, dtype=np.int32)
+            num_stations = len(self.stations)
+        else:
+            self.stations = None
+        self.time = np.zeros(1, dtype=np.float64)
+        self.queueSize = np.zeros((num_stations, 2), dtype=np.int32)
+        self.delay = np.zeros((num_stations, 2), dtype=np.float64)
+        self.numPass = np.zeros((num_stations, 2), dtype=np.int32)
+        self.trainLoad = np.zeros(dll.getTrainNum(), dtype=np.int32)
+
+        self.buffer = StateBuffer(self.time.ctypes.data_as(POINTER(c_double)),
+                                  self.queueSize.ctypes.data_as(POINTER(c_int)),
+                                  self.delay.ctypes.data_as(POINTER(c_double)),
+                                  self.numPass.ctypes.data_as(POINTER(c_int)),
+                                  self.trainLoad.ctypes.data_as(POINTER(c_int)))
+        if self.stations is not None:
+            self.layout = StateLayout(self.stations.ctypes.data_as(POINTER(c_int)), num_stations)
+        else:
+            self.layout = StateLayout(None, 0)
+
+    def update(self, handle=None):
+        # read the state of the global simulator, or of the simulator with the handle
+        if handle is None:
+            self.dll.exportState(byref(self.buffer), byref(self.layout))
+        else:
+            self.dll.exportStateOf(handle, byref(self.buffer), byref(self.layout))
+        return self
+
+class SimulatorError(RuntimeError):
+    """
+    an error of the simulator, e.g. a simulator handle which doesn't exist
+    """
+    pass
+
 def initAPI(dll):
     """
     function to init the API of the dll for python calls
+    the exports which fail return -1 (see main.cpp), a SimulatorError is raised then
     """
-    dll.initSim.restype = c_void_p
-    dll.resetSim.restype = c_void_p
-    dll.runSim.restype = c_void_p
+    dll.lastErrorSim.restype = c_char_p
+    dll.initSim.restype = c_int
+    dll.resetSim.restype = c_int
+    dll.setSchedulerSim.argtypes = [c_int] # 0 binary heap, 1 4-ary heap, 2 calendar queue
+    dll.setSchedulerSim.restype = c_int
+    dll.runSim.restype = c_int
     dll.SimIsFinished.restype = c_bool
     dll.getTotalTravelTime.restype = c_double
     dll.getTotalDelay.restype = c_double
@@ -248,10 +329,136 @@ def initAPI(dll):
     dll.getStationWaitingPassengers.restype = c_int
 
     dll.addSuspend.argtypes = [c_double]
-    dll.addSuspend.restype = c_void_p
+    dll.addSuspend.restype = c_int
 
     dll.addOD.argtypes = [c_double, c_int, c_int, c_int] # time, from, to, num
-    dll.addOD.restype = c_void_p
+    dll.addOD.restype = c_int
+
+    dll.addODBatch.argtypes = [POINTER(c_double), POINTER(c_int), POINTER(c_int), POINTER(c_int), c_size_t] # time, from, to, num, n
+    dll.addODBatch.restype = c_int
+
+    dll.injectIncidentSim.argtypes = [c_int, c_int, c_int, c_double, c_double, c_int] # line, from, to, start, end, type (0 delay, 1 short turn)
+    dll.injectIncidentSim.restype = c_int
+
+    dll.closeLinkSim.argtypes = [c_int, c_int] # from, to
+    dll.closeLinkSim.restype = c_int
+    dll.reopenLinkSim.argtypes = [c_int, c_int]
+    dll.reopenLinkSim.restype = c_int
+    dll.closeStationSim.argtypes = [c_int]
+    dll.closeStationSim.restype = c_int
+    dll.reopenStationSim.argtypes = [c_int]
+    dll.reopenStationSim.restype = c_int
+
+    dll.getTrainNum.restype = c_int
+
+    dll.runReplicationsSim.argtypes = [c_int, c_uint, c_int, POINTER(c_double), POINTER(c_double)] # n, seed, threads, summary[12], results[n * 4]
+    dll.runReplicationsSim.restype = c_int
+    dll.buildRoutesSim.argtypes = [c_char_p, c_char_p, c_char_p, c_int] # links, off-peak links (or None), out dir, threads
+    dll.buildRoutesSim.restype = c_bool
+    dll.getStats.argtypes = [POINTER(c_longlong), POINTER(c_longlong)] # counters[11], histograms (or None), 0 if compiled out
+    dll.getStats.restype = c_int
+    dll.openLogSim.argtypes = [c_char_p] # the diagnostics go into this binary log instead of the console
+    dll.openLogSim.restype = c_bool
+    dll.flushLogSim.restype = c_int
+    dll.closeLogSim.restype = c_int
+    dll.getLogDropped.restype = c_longlong
+    dll.exportState.argtypes = [POINTER(StateBuffer), POINTER(StateLayout)]
+    dll.exportState.restype = c_int
+
+    dll.snapshotSim.restype = c_int
+
+    dll.restoreSim.argtypes = [c_int]
+    dll.restoreSim.restype = c_int
+    dll.seedSim.argtypes = [c_uint, c_ulonglong]
+    dll.seedSim.restype = c_int
+
+    dll.releaseSnapshotSim.argtypes = [c_int]
+    dll.releaseSnapshotSim.restype = c_int
+
+    # several simulators in one process, referred to by handles
+    dll.createSim.argtypes = [c_uint] # seed
+    dll.createSim.restype = c_int
+    dll.destroySim.argtypes = [c_int]
+    dll.destroySim.restype = c_int
+    dll.setNumThreads.argtypes = [c_int]
+    dll.setNumThreads.restype = c_int
+    dll.resetSimOf.argtypes = [c_int]
+    dll.resetSimOf.restype = c_int
+    dll.runSimOf.argtypes = [c_int]
+    dll.runSimOf.restype = c_int
+    dll.stepMany.argtypes = [POINTER(c_int), c_int] # handles, n
+    dll.stepMany.restype = c_int
+    dll.SimIsFinishedOf.argtypes = [c_int]
+    dll.SimIsFinishedOf.restype = c_int # 1 finished, 0 not
+    dll.getTotalTravelTimeOf.argtypes = [c_int]
+    dll.getTotalTravelTimeOf.restype = c_double
+    dll.getTotalDelayOf.argtypes = [c_int]
+    dll.getTotalDelayOf.restype = c_double
+    dll.getTimeOf.argtypes = [c_int]
+    dll.getTimeOf.restype = c_double
+    dll.addSuspendOf.argtypes = [c_int, c_double]
+    dll.addSuspendOf.restype = c_int
+    dll.addODOf.argtypes = [c_int, c_double, c_int, c_int, c_int] # handle, time, from, to, num
+    dll.addODOf.restype = c_int
+    dll.addODBatchOf.argtypes = [c_int, POINTER(c_double), POINTER(c_int), POINTER(c_int), POINTER(c_int), c_size_t]
+    dll.addODBatchOf.restype = c_int
+    dll.injectIncidentOf.argtypes = [c_int, c_int, c_int, c_int, c_double, c_double, c_int]
+    dll.injectIncidentOf.restype = c_int
+    dll.closeLinkOf.argtypes = [c_int, c_int, c_int]
+    dll.closeLinkOf.restype = c_int
+    dll.reopenLinkOf.argtypes = [c_int, c_int, c_int]
+    dll.reopenLinkOf.restype = c_int
+    dll.closeStationOf.argtypes = [c_int, c_int]
+    dll.closeStationOf.restype = c_int
+    dll.reopenStationOf.argtypes = [c_int, c_int]
+    dll.reopenStationOf.restype = c_int
+    dll.exportStateOf.argtypes = [c_int, POINTER(StateBuffer), POINTER(StateLayout)]
+    dll.exportStateOf.restype = c_int
+    dll.getStatsOf.argtypes = [c_int, POINTER(c_longlong), POINTER(c_longlong)]
+    dll.getStatsOf.restype = c_int
+    # what-if rollouts: candidates, offsets[candidates + 1], time, from, to, num, horizon, results[4 * candidates]
+    dll.evaluateCandidatesSim.argtypes = [c_int, POINTER(c_int), POINTER(c_double), POINTER(c_int), POINTER(c_int), \
+        POINTER(c_int), c_double, POINTER(c_double)]
+    dll.evaluateCandidatesSim.restype = c_int
+    dll.evaluateCandidatesOf.argtypes = [c_int, c_int, POINTER(c_int), POINTER(c_double), POINTER(c_int), POINTER(c_int), \
+        POINTER(c_int), c_double, POINTER(c_double)]
+    dll.evaluateCandidatesOf.restype = c_int
+    # the lines on several threads: numPartitions (<= 0 for one per group of lines)
+    dll.runParallelSim.argtypes = [c_int]
+    dll.runParallelSim.restype = c_int
+    dll.runParallelOf.argtypes = [c_int, c_int]
+    dll.runParallelOf.restype = c_int
+    dll.runFluidSim.argtypes = [c_double]
+    dll.runFluidSim.restype = c_int
+    dll.runFluidOf.argtypes = [c_int, c_double]
+    dll.runFluidOf.restype = c_int
+    dll.fitFluidSim.argtypes = []
+    dll.fitFluidSim.restype = c_int
+    dll.fitFluidOf.argtypes = [c_int]
+    dll.fitFluidOf.restype = c_int
+    # results: 11 doubles, see calibrateFluidSim() in main.cpp
+    dll.calibrateFluidSim.argtypes = [c_double, POINTER(c_double)]
+    dll.calibrateFluidSim.restype = c_int
+    dll.snapshotSimOf.argtypes = [c_int]
+    dll.snapshotSimOf.restype = c_int
+    dll.restoreSimOf.argtypes = [c_int, c_int]
+    dll.restoreSimOf.restype = c_int
+
+    def check(result, func, args):
+        if result == -1:
+            raise SimulatorError("%s: %s" % (func.__name__, dll.lastErrorSim().decode()))
+        return result
+    # the others only read the report or the time and can't fail, the bools are false if they fail
+    for name in ["initSim", "resetSim", "setSchedulerSim", "snapshotSim", "restoreSim", "releaseSnapshotSim", "seedSim", \
+        "runSim", "getStationDelay", "getStationPass", "getStationWaitingPassengers", "addSuspend", "addOD", "addODBatch", \
+        "injectIncidentSim", "closeLinkSim", "reopenLinkSim", "closeStationSim", "reopenStationSim", "exportState", \
+        "createSim", "destroySim", "setNumThreads", "resetSimOf", "runSimOf", "stepMany", "SimIsFinishedOf", \
+        "getTotalTravelTimeOf", "getTotalDelayOf", "getTimeOf", "runReplicationsSim", "getStats", "flushLogSim", \
+        "closeLogSim", "addSuspendOf", "addODOf", "injectIncidentOf", "closeLinkOf", "reopenLinkOf", "closeStationOf", \
+        "reopenStationOf", "exportStateOf", "getStatsOf", "addODBatchOf", "evaluateCandidatesSim", "evaluateCandidatesOf", \
+        "runParallelSim", "runParallelOf", "runFluidSim", "runFluidOf", "fitFluidSim", "fitFluidOf", "calibrateFluidSim", \
+        "snapshotSimOf", "restoreSimOf"]:
+        getattr(dll, name).errcheck = check
 
 def loadODQueue(_file):
     """